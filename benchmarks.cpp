@@ -0,0 +1,190 @@
+/*
+Micro-benchmarks for interpreter built-ins. Not part of the test suite,
+run the benchmarks executable directly from a release build.
+ */
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "expression.hpp"
+#include "interpreter.hpp"
+
+// time a single call of fn in milliseconds
+double time_ms(const std::function<void()> & fn){
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+void bench_sort(){
+  Environment env;
+  Procedure sort = env.get_proc(Atom("sort"));
+
+  std::mt19937 gen(3574);
+  std::uniform_real_distribution<double> dist(-1e6, 1e6);
+
+  std::cout << "sort" << std::endl;
+  std::cout << std::setw(12) << "n" << std::setw(16) << "ascending ms" << std::setw(16) << "descending ms" << std::endl;
+
+  for(std::size_t n = 1000; n <= 10000000; n *= 10){
+    std::vector<Expression> args(1, Expression(Atom("list")));
+    for(std::size_t i = 0; i < n; ++i){
+      args[0].append(dist(gen));
+    }
+
+    double up = time_ms([&](){ sort(args); });
+
+    args.emplace_back(Atom("\"descending\""));
+    double down = time_ms([&](){ sort(args); });
+
+    std::cout << std::setw(12) << n << std::setw(16) << up << std::setw(16) << down << std::endl;
+  }
+}
+
+void bench_traversal(){
+  Environment env;
+  Procedure list = env.get_proc(Atom("list"));
+  Procedure first = env.get_proc(Atom("first"));
+  Procedure rest = env.get_proc(Atom("rest"));
+  Procedure nth = env.get_proc(Atom("nth"));
+
+  std::cout << "list traversal" << std::endl;
+  std::cout << std::setw(12) << "n" << std::setw(16) << "first/rest ms" << std::setw(16) << "ns per elem"
+            << std::setw(16) << "nth ms" << std::endl;
+
+  for(std::size_t n = 1000; n <= 1000000; n *= 10){
+    std::vector<Expression> elements;
+    for(std::size_t i = 0; i < n; ++i){
+      elements.emplace_back(double(i));
+    }
+    Expression data = list(elements);
+
+    // the recursive walk: (f (rest l)) until l is empty
+    double sum = 0;
+    double walk = time_ms([&](){
+      std::vector<Expression> args(1, data);
+      while(args[0].tailSize() != 0){
+        sum += first(args).head().asNumber();
+        args[0] = rest(args);
+      }
+    });
+
+    double index = time_ms([&](){
+      std::vector<Expression> args = {data, Expression()};
+      for(std::size_t i = 0; i < n; ++i){
+        args[1] = Expression(double(i));
+        sum -= nth(args).head().asNumber();
+      }
+    });
+
+    std::cout << std::setw(12) << n << std::setw(16) << walk << std::setw(16) << (walk * 1e6) / n
+              << std::setw(16) << index << (sum == 0 ? "" : " (mismatch)") << std::endl;
+  }
+}
+
+void bench_append(){
+  Environment env;
+  Procedure list = env.get_proc(Atom("list"));
+  Procedure append = env.get_proc(Atom("append"));
+  Procedure join = env.get_proc(Atom("join"));
+
+  std::cout << "append/join accumulation" << std::endl;
+  std::cout << std::setw(12) << "n" << std::setw(16) << "append ms" << std::setw(16) << "ns per append"
+            << std::setw(16) << "join ms" << std::endl;
+
+  for(std::size_t n = 1000; n <= 1000000; n *= 10){
+
+    // collect n samples one append at a time
+    std::vector<Expression> args = {list(std::vector<Expression>()), Expression()};
+    double grow = time_ms([&](){
+      for(std::size_t i = 0; i < n; ++i){
+        args[1] = Expression(double(i));
+        args[0] = append(args);
+      }
+    });
+
+    // join the accumulated list onto itself repeatedly
+    double cat = time_ms([&](){
+      std::vector<Expression> pair = {args[0], args[0]};
+      for(int i = 0; i < 1000; ++i){
+        pair[0] = join(pair);
+      }
+    });
+
+    std::cout << std::setw(12) << n << std::setw(16) << grow << std::setw(16) << (grow * 1e6) / n
+              << std::setw(16) << cat << std::endl;
+  }
+}
+
+void bench_sampling(){
+  Environment env;
+  Interpreter interp;
+
+  std::istringstream iss("(lambda (x) (+ (* x (sin x)) (/ 1 (+ 2 (cos x)))))");
+  interp.parseStream(iss);
+  Expression lambda = interp.evaluate();
+
+  std::cout << "lambda sampling" << std::endl;
+  std::cout << std::setw(12) << "n" << std::setw(16) << "batch ms" << std::setw(16) << "ns per sample" << std::endl;
+
+  for(std::size_t n = 1000; n <= 1000000; n *= 10){
+    std::vector<double> xs;
+    for(std::size_t i = 0; i < n; ++i){
+      xs.push_back(-10 + 20.0 * i / n);
+    }
+
+    double batch = time_ms([&](){ evaluate_lambda(lambda, xs, env); });
+
+    std::cout << std::setw(12) << n << std::setw(16) << batch << std::setw(16) << (batch * 1e6) / n << std::endl;
+  }
+}
+
+void bench_plot(){
+  std::cout << "discrete-plot build" << std::endl;
+  std::cout << std::setw(12) << "n" << std::setw(16) << "build ms" << std::setw(16) << "read ms" << std::endl;
+
+  for(std::size_t n = 1000; n <= 100000; n *= 10){
+    Interpreter interp;
+    std::ostringstream program;
+    program << "(begin (define f (lambda (x) (list x (sin x)))) "
+            << "(define data (map f (range 0 " << n - 1 << " 1))) data)";
+    std::istringstream iss(program.str());
+    interp.parseStream(iss);
+    interp.evaluate();
+
+    Expression plot;
+    double build = time_ms([&](){
+      std::istringstream plot_program("(discrete-plot data (list (list \"title\" \"bench\")))");
+      interp.parseStream(plot_program);
+      plot = interp.evaluate();
+    });
+
+    // the legacy decode, reading every primitive as an Expression
+    double read = time_ms([&](){
+      for(int i = 0; i < plot.tailSize(); ++i){
+        plot.tailAt(i).get_property(Atom("\"object-name\""));
+      }
+    });
+
+    std::cout << std::setw(12) << n << std::setw(16) << build << std::setw(16) << read << std::endl;
+  }
+}
+
+int main(){
+
+  bench_sort();
+  bench_traversal();
+  bench_append();
+  bench_sampling();
+  bench_plot();
+
+  return EXIT_SUCCESS;
+}
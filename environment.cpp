@@ -6,7 +6,9 @@
 #include <string>
 
 #include "environment.hpp"
+#include "parallel.hpp"
 #include "semantic_error.hpp"
+#include "sequence.hpp"
 
 /*********************************************************************** 
 Helper Functions
@@ -17,6 +19,31 @@ bool nargs_equal(const std::vector<Expression> & args, unsigned nargs){
   return args.size() == nargs;
 }
 
+// predicate, the argument is a whole number in [0, limit]
+bool is_index(const Expression & arg, int limit){
+  if(!arg.isHeadNumber()) return false;
+
+  double index = arg.head().asNumber();
+  return (index == std::floor(index)) && (index >= 0) && (index <= limit);
+}
+
+// the shared sequence backing a list, copying the tail into one if needed
+std::shared_ptr<const Sequence> as_sequence(const Expression & list){
+  if(list.isSequence()) return list.sequence();
+
+  return std::make_shared<VectorSequence>(std::vector<Expression>(list.tailConstBegin(), list.tailConstEnd()));
+}
+
+// the persistent sequence backing a list, wrapping other sequences without copying
+std::shared_ptr<const PersistentSequence> as_persistent(const Expression & list){
+  auto seq = as_sequence(list);
+
+  auto persistent = std::dynamic_pointer_cast<const PersistentSequence>(seq);
+  if(persistent) return persistent;
+
+  return std::make_shared<PersistentSequence>(seq);
+}
+
 /*********************************************************************** 
 Each of the functions below have the signature that corresponds to the
 typedef'd Procedure function pointer.
@@ -458,19 +485,15 @@ Expression conj(const std::vector<Expression> & args){
 
 Expression list(const std::vector<Expression> & args){
 
-  Expression result(Atom("list"));
-
-  // check if all arguments are valid while adding to list
+  // check if all arguments are valid
   for (auto & a : args) {
-    if (a.isHeadNumber() || a.isHeadComplex() || a.isList() || a.isStringLit()) {
-      result.append(a);
-    }
-    else {
+    if (!(a.isHeadNumber() || a.isHeadComplex() || a.isList() || a.isStringLit())) {
       throw SemanticError("Error in call to build list: invalid argument");
     }
   }
-  
-  return result;
+
+  // elements live in shared storage so copies and slices of the list are O(1)
+  return Expression(std::make_shared<VectorSequence>(args));
 };
 
 Expression first(const std::vector<Expression> & args){
@@ -478,8 +501,8 @@ Expression first(const std::vector<Expression> & args){
   // preconditions
   if (nargs_equal(args, 1)) {
     if (args[0].isList()) {
-      if (args[0].tailConstBegin() != args[0].tailConstEnd()) {
-        return Expression(*args[0].tailConstBegin());
+      if (args[0].tailSize() != 0) {
+        return args[0].tailAt(0);
       }
       else {
         throw SemanticError("Error in call to first: argument is an empty list");
@@ -497,15 +520,14 @@ Expression first(const std::vector<Expression> & args){
 
 Expression rest(const std::vector<Expression> & args) {
 
-  Expression result(Atom("list"));
+  Expression result;
 
   // preconditions
   if (nargs_equal(args, 1)) {
     if (args[0].isList()) {
-      if (args[0].tailConstBegin() != args[0].tailConstEnd()) {
-        for (auto it = args[0].tailConstBegin() + 1; it != args[0].tailConstEnd(); ++it) {
-          result.append(*it);
-        }
+      if (args[0].tailSize() != 0) {
+        // a view sharing the storage of the argument, no elements are copied
+        result = Expression(as_sequence(args[0])->slice(1, args[0].tailSize()));
       }
       else {
         throw SemanticError("Error in call to rest: argument is an empty list");
@@ -522,22 +544,90 @@ Expression rest(const std::vector<Expression> & args) {
   return result;
 };
 
-Expression length(const std::vector<Expression> & args) {
-  
-  int result = 0;
+Expression last(const std::vector<Expression> & args){
 
   // preconditions
   if (nargs_equal(args, 1)) {
     if (args[0].isList()) {
-      if (args[0].tailConstBegin() == args[0].tailConstEnd()) {
-        return Expression(result);
+      if (args[0].tailSize() != 0) {
+        return args[0].tailAt(args[0].tailSize() - 1);
       }
       else {
-        for (auto it = args[0].tailConstBegin(); it != args[0].tailConstEnd(); ++it) {
-          result++;
+        throw SemanticError("Error in call to last: argument is an empty list");
+      }
+    }
+    else {
+      throw SemanticError("Error in call to last: argument not a list");
+    }
+  }
+  else {
+    throw SemanticError("Error in call to last: more than one argument");
+  }
+
+};
+
+Expression nth(const std::vector<Expression> & args){
+
+  // preconditions
+  if (nargs_equal(args, 2)) {
+    if (args[0].isList()) {
+      if (is_index(args[1], args[0].tailSize() - 1)) {
+        return args[0].tailAt(args[1].head().asNumber());
+      }
+      else {
+        throw SemanticError("Error in call to nth: index not a whole number within the list");
+      }
+    }
+    else {
+      throw SemanticError("Error in call to nth: first argument not a list");
+    }
+  }
+  else {
+    throw SemanticError("Error in call to nth: invalid number of arguments");
+  }
+
+};
+
+Expression slice(const std::vector<Expression> & args){
+
+  // preconditions
+  if (nargs_equal(args, 3)) {
+    if (args[0].isList()) {
+      if (is_index(args[1], args[0].tailSize()) && is_index(args[2], args[0].tailSize())) {
+        std::size_t begin = args[1].head().asNumber();
+        std::size_t end = args[2].head().asNumber();
+
+        if (begin <= end) {
+          // a view sharing the storage of the argument, no elements are copied
+          return Expression(as_sequence(args[0])->slice(begin, end));
         }
+        else {
+          throw SemanticError("Error in call to slice: begin greater than end");
+        }
+      }
+      else {
+        throw SemanticError("Error in call to slice: index not a whole number within the list");
       }
     }
+    else {
+      throw SemanticError("Error in call to slice: first argument not a list");
+    }
+  }
+  else {
+    throw SemanticError("Error in call to slice: invalid number of arguments");
+  }
+
+};
+
+Expression length(const std::vector<Expression> & args) {
+  
+  int result = 0;
+
+  // preconditions
+  if (nargs_equal(args, 1)) {
+    if (args[0].isList()) {
+      result = args[0].tailSize();
+    }
     else {
       throw SemanticError("Error in call to length: argument not a list");
     }
@@ -551,17 +641,14 @@ Expression length(const std::vector<Expression> & args) {
 
 Expression append(const std::vector<Expression> & args){
 
-  Expression result(Atom("list"));
+  Expression result;
 
   // preconditions
   if (nargs_equal(args, 2)) {
     if (args[0].isList()) {
       if (args[1].isHeadNumber() || args[1].isHeadComplex() || args[1].isList()) {
-        for (auto it = args[0].tailConstBegin(); it != args[0].tailConstEnd(); ++it) {
-          result.append(*it);
-        }
-        
-        result.append(args[1]);
+        // amortized O(1), the argument list is shared and left unchanged
+        result = Expression(as_persistent(args[0])->append(args[1]));
       }
       else {
         throw SemanticError("Error in call to append: invalid second argument");
@@ -580,17 +667,14 @@ Expression append(const std::vector<Expression> & args){
 
 Expression join(const std::vector<Expression> & args){
 
-  Expression result(Atom("list"));
+  Expression result;
 
   // preconditions
   if (nargs_equal(args, 2)) {
     if (args[0].isList()) {
       if (args[1].isList()) {
-        for (int i = 0; i < 2; ++i) {
-          for (auto it = args[i].tailConstBegin(); it != args[i].tailConstEnd(); ++it) {
-            result.append(*it);
-          }
-        }
+        // O(log n), both argument lists are shared and left unchanged
+        result = Expression(as_persistent(args[0])->join(as_sequence(args[1])));
       }
       else {
         throw SemanticError("Error in call to join: second argument not a list");
@@ -609,7 +693,7 @@ Expression join(const std::vector<Expression> & args){
 
 Expression range(const std::vector<Expression> & args) {
 
-  Expression result(Atom("list"));
+  Expression result;
 
   // preconditions
   if (nargs_equal(args, 3)) {
@@ -620,9 +704,8 @@ Expression range(const std::vector<Expression> & args) {
           double end = args[1].head().asNumber();
           double inc = args[2].head().asNumber();
 
-          for (double i = begin; i <= end; i += inc) {
-            result.append(i);
-          }
+          // elements are produced on demand, nothing is allocated per element
+          result = Expression(std::make_shared<RangeSequence>(begin, end, inc));
         }
         else {
           throw SemanticError("Error in call to range: negative or zero increment");
@@ -643,11 +726,61 @@ Expression range(const std::vector<Expression> & args) {
   return result;
 };
 
+Expression sort(const std::vector<Expression> & args) {
+
+  Expression result(Atom("list"));
+  bool descending = false;
+
+  // preconditions
+  if (nargs_equal(args, 1) || nargs_equal(args, 2)) {
+    if (!args[0].isList()) {
+      throw SemanticError("Error in call to sort: first argument not a list");
+    }
+    if (nargs_equal(args, 2)) {
+      if (args[1].head().asSymbol() == "\"descending\"") descending = true;
+      else if (args[1].head().asSymbol() != "\"ascending\"") {
+        throw SemanticError("Error in call to sort: second argument not \"ascending\" or \"descending\"");
+      }
+    }
+  }
+  else {
+    throw SemanticError("Error in call to sort: invalid number of arguments");
+  }
+
+  // pack numbers into a flat buffer so they can be sorted in place
+  std::vector<double> values;
+  values.reserve(args[0].tailSize());
+  for (int i = 0; i < args[0].tailSize(); ++i) {
+    Expression element = args[0].tailAt(i);
+    if (!element.isHeadNumber() || element.tailSize() != 0) {
+      throw SemanticError("Error in call to sort: list element not a number");
+    }
+    // NaN is unordered, it would break the strict weak ordering of the sort
+    if (std::isnan(element.head().asNumber())) {
+      throw SemanticError("Error in call to sort: list element is NaN");
+    }
+    values.push_back(element.head().asNumber());
+  }
+
+  if (descending) {
+    parallel_sort(values.begin(), values.end(), [](double a, double b){ return a > b; });
+  }
+  else {
+    parallel_sort(values.begin(), values.end());
+  }
+
+  for (auto v : values) {
+    result.append(v);
+  }
+
+  return result;
+};
+
 const double PI = std::atan2(0, -1);
 const double EXP = std::exp(1);
 const std::complex<double> I(0,1);
 
-Environment::Environment(){
+Environment::Environment(): m_streamed(nullptr){
 
   reset();
 }
@@ -712,6 +845,38 @@ Procedure Environment::get_proc(const Atom & sym) const{
   return default_proc;
 }
 
+void Environment::set_interrupt(std::shared_ptr<Interrupt> interrupt){
+  m_interrupt = interrupt;
+}
+
+Interrupt * Environment::interrupt() const noexcept{
+  return m_interrupt.get();
+}
+
+void Environment::set_plot_sink(std::shared_ptr<PlotSink> sink){
+  m_plot_sink = sink;
+}
+
+PlotSink * Environment::plot_sink() const noexcept{
+  return m_plot_sink.get();
+}
+
+void Environment::set_streamed(const Expression * exp){
+  m_streamed = exp;
+}
+
+PlotSink * Environment::plot_sink(const Expression & exp) const noexcept{
+  return (&exp == m_streamed) ? m_plot_sink.get() : nullptr;
+}
+
+void Environment::set_sampler_registry(std::shared_ptr<SamplerRegistry> registry){
+  m_sampler_registry = registry;
+}
+
+SamplerRegistry * Environment::sampler_registry() const noexcept{
+  return m_sampler_registry.get();
+}
+
 /*
 Reset the environment to the default state. First remove all entries and
 then re-add the default ones.
@@ -786,6 +951,15 @@ void Environment::reset(){
   // Procedure: length;
   envmap.emplace("length", EnvResult(ProcedureType, length));
 
+  // Procedure: last;
+  envmap.emplace("last", EnvResult(ProcedureType, last));
+
+  // Procedure: nth;
+  envmap.emplace("nth", EnvResult(ProcedureType, nth));
+
+  // Procedure: slice;
+  envmap.emplace("slice", EnvResult(ProcedureType, slice));
+
   // Procedure: append;
   envmap.emplace("append", EnvResult(ProcedureType, append));
 
@@ -794,4 +968,7 @@ void Environment::reset(){
 
   // Procedure: range;
   envmap.emplace("range", EnvResult(ProcedureType, range));
+
+  // Procedure: sort;
+  envmap.emplace("sort", EnvResult(ProcedureType, sort));
 }
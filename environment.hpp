@@ -12,10 +12,15 @@ needed.
 
 // system includes
 #include <map>
+#include <memory>
 
 // module includes
 #include "atom.hpp"
 #include "expression.hpp"
+#include "interrupt.hpp"
+
+class PlotSink;
+class SamplerRegistry;
 
 /*! \typedef Procedure
 \brief A Procedure is a C++ function pointer taking a vector of 
@@ -86,6 +91,42 @@ public:
   /*! Reset the environment to its default state. */
   void reset();
 
+  /*! Set the Interrupt checked while evaluating in this environment,
+      shared with every copy made from it afterwards.
+    \param interrupt the interrupt, or nullptr for none
+   */
+  void set_interrupt(std::shared_ptr<Interrupt> interrupt);
+
+  /// the Interrupt checked while evaluating, or nullptr
+  Interrupt * interrupt() const noexcept;
+
+  /*! Set the PlotSink the plot procedures publish to while building,
+      shared with every copy made from it afterwards.
+    \param sink the sink, or nullptr for none
+   */
+  void set_plot_sink(std::shared_ptr<PlotSink> sink);
+
+  /// the PlotSink the plot procedures publish to, or nullptr
+  PlotSink * plot_sink() const noexcept;
+
+  /*! Set the expression whose plot is published while it is built, the one
+      giving the result, so plots built on the way to it are not drawn
+    \param exp the expression, or nullptr for none
+   */
+  void set_streamed(const Expression * exp);
+
+  /// the PlotSink the plot built by exp publishes to, nullptr unless exp is the streamed expression
+  PlotSink * plot_sink(const Expression & exp) const noexcept;
+
+  /*! Set the SamplerRegistry continuous-plot registers its curves in,
+      shared with every copy made from it afterwards.
+    \param registry the registry, or nullptr for none
+   */
+  void set_sampler_registry(std::shared_ptr<SamplerRegistry> registry);
+
+  /// the SamplerRegistry continuous-plot registers its curves in, or nullptr
+  SamplerRegistry * sampler_registry() const noexcept;
+
 private:
   
   // Environment is a mapping from symbols to expressions or procedures
@@ -104,6 +145,18 @@ private:
 
   // the environment map
   std::map<std::string, EnvResult> envmap;
+
+  // cancellation of the evaluation using this environment, if any
+  std::shared_ptr<Interrupt> m_interrupt;
+
+  // receiver of plots while they are built, if any
+  std::shared_ptr<PlotSink> m_plot_sink;
+
+  // the expression giving the result, the only one whose plot is published
+  const Expression * m_streamed;
+
+  // keeper of continuous plot curves for re-sampling, if any
+  std::shared_ptr<SamplerRegistry> m_sampler_registry;
 };
 
 #endif
@@ -1,9 +1,18 @@
 #include "expression.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <sstream>
 
 #include "environment.hpp"
+#include "hash.hpp"
+#include "interrupt.hpp"
+#include "parallel.hpp"
+#include "plot.hpp"
+#include "sampler.hpp"
 #include "semantic_error.hpp"
+#include "sequence.hpp"
 
 Expression::Expression(){}
 
@@ -12,6 +21,12 @@ Expression::Expression(const Atom & a){
   m_head = a;
 }
 
+Expression::Expression(std::shared_ptr<const Sequence> seq){
+
+  m_head = Atom("list");
+  m_seq = seq;
+}
+
 // recursive copy
 Expression::Expression(const Expression & a){
 
@@ -19,9 +34,11 @@ Expression::Expression(const Expression & a){
   for(auto e : a.m_tail){
     m_tail.push_back(e);
   }
+  m_seq = a.m_seq;
 
   // carry over properties
   propmap = a.propmap;
+  m_kind = a.m_kind;
 }
 
 Expression & Expression::operator=(const Expression & a){
@@ -33,9 +50,11 @@ Expression & Expression::operator=(const Expression & a){
     for(auto e : a.m_tail){
       m_tail.push_back(e);
     } 
+    m_seq = a.m_seq;
 
     // carry over properties
     propmap = a.propmap;
+    m_kind = a.m_kind;
   }
   
   return *this;
@@ -66,6 +85,10 @@ bool Expression::isList() const noexcept {
   return m_head.asSymbol() == "list";
 }
 
+bool Expression::isSequence() const noexcept {
+  return m_seq != nullptr;
+}
+
 bool Expression::isLambda() const noexcept {
   return m_head.asSymbol() == "lambda";
 }
@@ -75,13 +98,25 @@ bool Expression::isStringLit() const noexcept {
 }
 
 void Expression::append(const Atom & a){
+  if(m_seq) materialize();
   m_tail.emplace_back(a);
 }
 
 void Expression::append(const Expression & e) {
+  if(m_seq) materialize();
   m_tail.push_back(e);
 }
 
+void Expression::materialize(){
+  std::shared_ptr<const Sequence> seq = m_seq;
+  m_seq = nullptr;
+
+  m_tail.reserve(m_tail.size() + seq->size());
+  for(std::size_t i = 0; i < seq->size(); ++i){
+    m_tail.push_back(seq->at(i));
+  }
+}
+
 Expression * Expression::tail(){
   Expression * ptr = nullptr;
   
@@ -100,10 +135,25 @@ Expression::ConstIteratorType Expression::tailConstEnd() const noexcept{
   return m_tail.cend();
 }
 
-int Expression::tailSize() {
+int Expression::tailSize() const {
+  if(m_seq) return m_seq->size();
   return m_tail.size();
 }
 
+Expression Expression::tailAt(std::size_t index) const{
+  if(m_seq) return m_seq->at(index);
+  return m_tail[index];
+}
+
+double Expression::numberAt(std::size_t index) const{
+  if(m_seq) return m_seq->at(index).head().asNumber();
+  return m_tail[index].head().asNumber();
+}
+
+std::shared_ptr<const Sequence> Expression::sequence() const noexcept{
+  return m_seq;
+}
+
 Expression apply(const Atom & op, const std::vector<Expression> & args, const Environment & env){
 
   // head must be a symbol
@@ -178,7 +228,7 @@ Expression Expression::handle_define(Environment & env){
   }
   
   if(env.is_proc(m_tail[0].head()) || m_tail[0].head().asSymbol() == "apply" || m_tail[0].head().asSymbol() == "map"
-    ||  m_tail[0].head().asSymbol() == "set-property" ||  m_tail[0].head().asSymbol() == "get-property"){
+    ||  m_tail[0].head().asSymbol() == "filter" ||  m_tail[0].head().asSymbol() == "sort-by" ||  m_tail[0].head().asSymbol() == "set-property" ||  m_tail[0].head().asSymbol() == "get-property"){
     throw SemanticError("Error during evaluation: attempt to redefine a built-in procedure");
   }
   
@@ -237,6 +287,18 @@ Expression Expression::handle_lambda(Environment & env){
   return result;
 }
 
+// the primitive an "object-name" property value names
+static Expression::ObjectKind object_kind_of(const Expression & name){
+  const std::pair<const char *, Expression::ObjectKind> KINDS[] = {
+    {"\"point\"", Expression::POINT}, {"\"line\"", Expression::LINE}, {"\"text\"", Expression::TEXT},
+    {"\"image\"", Expression::IMAGE}, {"\"polyline\"", Expression::POLYLINE}};
+
+  for(auto & kind : KINDS){
+    if(name == Expression(Atom(kind.first))) return kind.second;
+  }
+  return Expression::OTHER;
+}
+
 void Expression::set_property(const Atom & sym, const Expression & exp){
     
   // allow overwriting of properties
@@ -244,6 +306,8 @@ void Expression::set_property(const Atom & sym, const Expression & exp){
     propmap[sym.asSymbol()] = exp;
   }
   else propmap.emplace(sym.asSymbol(),exp); 
+
+  if(sym.asSymbol() == "\"object-name\"") m_kind = object_kind_of(exp);
 }
 
 Expression Expression::get_property(const Atom & sym) const{
@@ -259,6 +323,22 @@ Expression Expression::get_property(const Atom & sym) const{
   return exp;
 }
 
+const Expression * Expression::find_property(const std::string & key) const noexcept{
+
+  auto result = propmap.find(key);
+  return (result != propmap.end()) ? &result->second : nullptr;
+}
+
+double Expression::number_property(const std::string & key, double fallback) const noexcept{
+
+  const Expression * property = find_property(key);
+  return (property && property->head().isNumber()) ? property->head().asNumber() : fallback;
+}
+
+Expression::ObjectKind Expression::object_kind() const noexcept{
+  return m_kind;
+}
+
 Expression Expression::handle_set_property(Environment & env){
 
   // tail must have size 3 or error
@@ -305,25 +385,90 @@ Expression Expression::handle_get_property(Environment & env){
   return result;
 }
 
-Expression Expression::handle_discrete_plot(Environment & env){
+// size of data points and bound label anchors
+const double PLOT_POINT_SIZE = 0.5;
 
-  Expression result(Atom("list"));
-  result.set_property(Atom("\"discrete-plot\""), Expression(Atom("\"true\"")));
+// default number of columns a discrete-plot is decimated to
+const double PLOT_RESOLUTION = 1000;
 
-  double x_min, x_max, y_min, y_max, x_val, y_val;
-  double text_scale = 1;
-  
-  Expression resetLine(Atom("list")), line, left_bound, right_bound, upper_bound, lower_bound, ordinate_cross, abscissa_cross;
-  resetLine.set_property(Atom("\"object-name\""), Expression(Atom("\"line\"")));
-  resetLine.set_property(Atom("\"thickness\""), Expression(Atom(0)));
-  left_bound = right_bound = upper_bound = lower_bound = ordinate_cross = abscissa_cross = line = resetLine;
+// default and largest number of cells across and down a density-plot
+const double PLOT_DENSITY_BINS = 64;
+const double PLOT_DENSITY_MAX_BINS = 4096;
+
+// default and largest number of samples across and down a heatmap-plot or contour-plot
+const double PLOT_FIELD_GRID = 64;
+const double PLOT_FIELD_MAX_GRID = 2048;
+
+// default and largest number of contour lines of a contour-plot
+const double PLOT_CONTOUR_LEVELS = 10;
+const double PLOT_CONTOUR_MAX_LEVELS = 1000;
+
+// bound lines around the plot area, and the axes where they cross it
+void add_plot_frame(PlotData & plot, double left, double right, double upper, double lower,
+  double x_min, double y_min){
+
+  plot.add_line(left, -upper, left, -lower, PLOT_LINE_THICKNESS);
+  plot.add_line(right, -upper, right, -lower, PLOT_LINE_THICKNESS);
+
+  // lower and upper bound lines (inverted in view)
+  plot.add_line(left, -lower, right, -lower, PLOT_LINE_THICKNESS);
+  plot.add_line(left, -upper, right, -upper, PLOT_LINE_THICKNESS);
+
+  if (x_min < 0) plot.add_line(0, -upper, 0, -lower, PLOT_LINE_THICKNESS);
+  if (y_min < 0) plot.add_line(left, 0, right, 0, PLOT_LINE_THICKNESS);
+}
 
-  Expression resetPoint(Atom("list")), point, pointA, pointB;
-  resetPoint.set_property(Atom("\"object-name\""), Expression(Atom("\"point\"")));
-  resetPoint.set_property(Atom("\"size\""), Expression(Atom(0.5)));
-  pointA = pointB = point = resetPoint;
+// title and axis labels requested in the options list
+void add_plot_labels(PlotData & plot, const Expression & options, double text_scale,
+  double left, double right, double upper, double lower){
 
-  Expression text;
+  for(auto it = options.tailConstBegin(); it != options.tailConstEnd(); ++it){
+    std::string key = it->tailConstBegin()->head().asSymbol();
+    std::string value = (it->tailConstEnd() - 1)->head().asSymbol();
+
+    if (key == "\"title\"") {
+      plot.add_text(value, ((right - left) / 2) + left, -upper - 3, 0, text_scale);
+    }
+    else if (key == "\"abscissa-label\"") {
+      plot.add_text(value, ((right - left) / 2) + left, -lower + 3, 0, text_scale);
+    }
+    else if (key == "\"ordinate-label\"") {
+      plot.add_text(value, left - 3, -1 * (((upper - lower) / 2) + lower), 0, text_scale,
+        -std::atan2(0, -1) / 2);
+    }
+  }
+}
+
+// the data bounds written at the corners of the plot area
+void add_bound_labels(PlotData & plot, double x_min, double x_max, double y_min, double y_max,
+  double text_scale, double left, double right, double upper, double lower){
+
+  std::ostringstream out;
+  out.precision(2);
+
+  auto label = [&](double value, double px, double py){
+    out.str("");
+    out << value;
+    plot.add_text(out.str(), px, py, PLOT_POINT_SIZE, text_scale);
+  };
+
+  label(y_max, left - 2, -upper);
+  label(y_min, left - 2, -lower);
+  label(x_max, right, -lower + 2);
+  label(x_min, left, -lower + 2);
+}
+
+// the list expression for a finished plot
+Expression make_plot(std::shared_ptr<const PlotData> plot){
+  Expression result(std::make_shared<PlotSequence>(plot));
+  result.set_property(Atom("\"discrete-plot\""), Expression(Atom("\"true\"")));
+  return result;
+}
+
+Expression Expression::handle_discrete_plot(Environment & env){
+
+  double x_min, x_max, y_min, y_max;
+  double text_scale = 1;
 
   // tail must have size 2 or error
   if(m_tail.size() != 2){
@@ -342,20 +487,37 @@ Expression Expression::handle_discrete_plot(Environment & env){
     throw SemanticError("Error during evaluation: first argument to discrete-plot not a non-empty list");
   }
 
-  // Determine max and min x and y values for plot
-  x_min = x_max = data.m_tail[0].tailConstBegin()->head().asNumber();
-  y_min = y_max = (data.m_tail[0].tailConstBegin() + 1)->head().asNumber();
+  // A list of point lists plots each as its own series
+  std::vector<Expression> sets;
+  if (data.tailAt(0).tailSize() > 0 && data.tailAt(0).tailAt(0).isList()) {
+    for(int s = 0; s < data.tailSize(); ++s){
+      sets.push_back(data.tailAt(s));
+      if (!sets.back().isList() || sets.back().tailSize() == 0) {
+        throw SemanticError("Error during evaluation: first argument to discrete-plot not a non-empty list");
+      }
+    }
+  }
+  else {
+    sets.push_back(data);
+  }
 
-  for(auto it = data.tailConstBegin(); it != data.tailConstEnd(); ++it){
-    x_val = it->m_tail[0].head().asNumber();
-    y_val = it->m_tail[1].head().asNumber();
-    
-    if (x_min > x_val) x_min = x_val;
-    else if (x_max < x_val) x_max = x_val;
-     
-    if (y_min > y_val) y_min = y_val;
-    else if (y_max < y_val) y_max = y_val; 
+  // Extract the data once into packed buffers, series after series, then
+  // determine max and min x and y values over all series in one pass
+  std::vector<double> xs, ys;
+  std::vector<std::size_t> starts;
+
+  for(auto & set : sets){
+    starts.push_back(xs.size());
+    for(int i = 0; i < set.tailSize(); ++i){
+      Expression datum = set.tailAt(i);
+      xs.push_back(datum.tailAt(0).head().asNumber());
+      ys.push_back(datum.tailAt(1).head().asNumber());
+    }
   }
+  starts.push_back(xs.size());
+
+  min_max(xs, x_min, x_max);
+  min_max(ys, y_min, y_max);
 
   // Create all lines necessary for plot
   double right, left, upper, lower;
@@ -368,101 +530,62 @@ Expression Expression::handle_discrete_plot(Environment & env){
   upper = y_max * y_coeff;
   lower = y_min * y_coeff;
 
-  // make left bound line
-  pointA.append(left);
-  pointA.append(-upper);
-  left_bound.append(pointA);
-  pointB.append(left);
-  pointB.append(-lower);
-  left_bound.append(pointB);
-  result.append(left_bound);
-  pointA = pointB = resetPoint;
-
-  // make right bound line
-  pointA.append(right);
-  pointA.append(-upper);
-  right_bound.append(pointA);
-  pointB.append(right);
-  pointB.append(-lower);
-  right_bound.append(pointB);
-  result.append(right_bound);
-  pointA = pointB = resetPoint;
-
-  // make lower bound line (inverted in view)
-  pointA.append(left);
-  pointA.append(-lower);
-  upper_bound.append(pointA);
-  pointB.append(right);
-  pointB.append(-lower);
-  upper_bound.append(pointB);
-  result.append(upper_bound);
-  pointA = pointB = resetPoint;
-
-  // make upper bound line (inverted in view)
-  pointA.append(left);
-  pointA.append(-upper);
-  lower_bound.append(pointA);
-  pointB.append(right);
-  pointB.append(-upper);
-  lower_bound.append(pointB);
-  result.append(lower_bound);
-  pointA = pointB = resetPoint;
-
-  // make ordinate cross line
-  if (x_min < 0) {
-    pointA.append(0);
-    pointA.append(-upper);
-    ordinate_cross.append(pointA);
-    pointB.append(0);
-    pointB.append(-lower);
-    ordinate_cross.append(pointB);
-    result.append(ordinate_cross);
-    pointA = pointB = resetPoint;
-  }
-
-  // make abscissa cross line
-  if (y_min < 0) {
-    pointA.append(left);
-    pointA.append(0);
-    abscissa_cross.append(pointA);
-    pointB.append(right);
-    pointB.append(0);
-    abscissa_cross.append(pointB);
-    result.append(abscissa_cross);
-  }
-
-  // Organize required points and lines for plot
-  for(auto it = data.tailConstBegin(); it != data.tailConstEnd(); ++it){
-    x_val = it->m_tail[0].head().asNumber();
-    y_val = it->m_tail[1].head().asNumber();
-
-    // scale
-    if (x_val >= 0) x_val *= (right / x_max);
-    else x_val *= (std::abs(left) / std::abs(x_min));
- 
-    // y-axis inverted in view
-    if (y_val >= 0) y_val *= (upper / y_max) * -1;
-    else y_val = y_val * (std::abs(lower) / std::abs(y_min)) * -1;
+  // the data is placed in view by scaling, y-axis inverted in view
+  auto plot = std::make_shared<PlotData>();
+  plot->view = PlotData::layout_view(x_min, x_max, y_min, y_max);
+  PlotStream stream(env.plot_sink(*this), *plot);
+  add_plot_frame(*plot, left, right, upper, lower, x_min, y_min);
 
-    pointA = pointB = point = resetPoint;
-    line = resetLine;
+  // Find the drawing resolution if any, 0 draws every point
+  double resolution = PLOT_RESOLUTION;
+  for(auto it = m_tail[1].tailConstBegin(); it != m_tail[1].tailConstEnd(); ++it){
+    if (it->tailConstBegin()->head().asSymbol() == "\"resolution\"") {
+      const Atom & value = (it->tailConstEnd() - 1)->head();
+      if (!value.isNumber() || value.asNumber() < 0) {
+        throw SemanticError("Error during evaluation: invalid resolution option to discrete-plot");
+      }
+      resolution = std::floor(value.asNumber());
+    }
+  }
 
-    point.append(x_val);
-    point.append(y_val);
-    result.append(point);
+  // Organize required points and stem lines for each series, in data
+  // coordinates, the stems rising from the x-axis or the lower bound in view.
+  // When a series has more points than columns only the extremes of each
+  // column are drawn, the raw data stays with the plot for redrawing a
+  // zoomed region
+  double stem = (y_min < 0) ? 0 : -lower;
+
+  // a decimated plot is kept so a front end zooming in can have it decimated again
+  bool decimated = false;
+  for(std::size_t s = 0; s + 1 < starts.size(); ++s){
+    if (resolution > 0 && starts[s + 1] - starts[s] > 2 * resolution) decimated = true;
+  }
+  SamplerRegistry * registry = env.sampler_registry();
+  if (decimated && registry) {
+    plot->sampler = registry->add(plot, x_min, x_max, stem, PLOT_POINT_SIZE);
+  }
 
-    pointA.append(x_val);
-    if (y_min < 0) pointA.append(0);
-    else pointA.append(-lower);
-    pointB.append(x_val);
-    pointB.append(y_val);
-    line.append(pointA);
-    line.append(pointB);
+  for(std::size_t s = 0; s + 1 < starts.size(); ++s){
+    std::vector<double> sx(xs.begin() + starts[s], xs.begin() + starts[s + 1]);
+    std::vector<double> sy(ys.begin() + starts[s], ys.begin() + starts[s + 1]);
 
-    result.append(line);
-  } 
+    std::vector<std::size_t> drawn;
+    if (resolution > 0 && sx.size() > 2 * resolution) {
+      drawn = decimate_min_max(sx, sy, x_min, x_max, static_cast<std::size_t>(resolution));
+    }
+    else {
+      for(std::size_t i = 0; i < sx.size(); ++i) drawn.push_back(i);
+    }
+
+    plot->begin_series();
+    for(auto i : drawn){
+      plot->add_point(sx[i], sy[i], PLOT_POINT_SIZE);
+      plot->add_stem(sx[i], sy[i], stem, PLOT_LINE_THICKNESS);
+      stream.flush();
+    }
+    plot->end_series();
+  }
 
-  
   // Find text scaling value if any
   for(auto it = m_tail[1].tailConstBegin(); it != m_tail[1].tailConstEnd(); ++it){
     if (it->tailConstBegin()->head().asSymbol() == "\"text-scale\"") {
@@ -470,121 +593,263 @@ Expression Expression::handle_discrete_plot(Environment & env){
     }
   }
 
+  add_plot_labels(*plot, m_tail[1], text_scale, left, right, upper, lower);
+  add_bound_labels(*plot, x_min, x_max, y_min, y_max, text_scale, left, right, upper, lower);
+
+  starts.pop_back();
+  plot->raw_x.swap(xs);
+  plot->raw_y.swap(ys);
+  plot->raw_series.swap(starts);
+
+  stream.finish();
+  return make_plot(plot);
+}
+
+Expression Expression::handle_density_plot(Environment & env){
+
+  double x_min, x_max, y_min, y_max;
+  double text_scale = 1;
+
+  // tail must have size 2 or error
+  if(m_tail.size() != 2){
+    throw SemanticError("Error during evaluation: invalid number of arguments to density-plot");
+  }
+
+  // tail[1] must contain a list
+  if (!m_tail[1].isList()) {
+    throw SemanticError("Error during evaluation: second argument to density-plot not a list");
+  }
+
+  Expression data = m_tail[0].eval(env);
+
+  // evaluated data must contain a non-empty list
+  if (!data.isList() || data.tailSize() == 0) {
+    throw SemanticError("Error during evaluation: first argument to density-plot not a non-empty list");
+  }
+
+  // Find the grid size and text scaling value if any
+  double bins = PLOT_DENSITY_BINS;
   for(auto it = m_tail[1].tailConstBegin(); it != m_tail[1].tailConstEnd(); ++it){
-    point = resetPoint;
-    point.set_property(Atom("\"size\""), Expression(Atom(0)));
-
-    if (it->tailConstBegin()->head().asSymbol() == "\"title\"") {
-      text = Expression((it->tailConstEnd() - 1)->head().asSymbol());
-      text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-      text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-      point.append(Atom(((right - left) / 2) + left));
-      point.append(Atom(-upper - 3));
-      text.set_property(Atom("\"position\""), point);
-      result.append(text);
-    }
+    std::string key = it->tailConstBegin()->head().asSymbol();
+    const Atom & value = (it->tailConstEnd() - 1)->head();
 
-    else if (it->tailConstBegin()->head().asSymbol() == "\"abscissa-label\"") {
-      text = Expression((it->tailConstEnd() - 1)->head().asSymbol());
-      text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-      text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-      point.append(Atom(((right - left) / 2) + left));
-      point.append(Atom(-lower + 3));
-      text.set_property(Atom("\"position\""), point);
-      result.append(text);
+    if (key == "\"bins\"") {
+      if (!value.isNumber() || value.asNumber() < 1 || value.asNumber() > PLOT_DENSITY_MAX_BINS) {
+        throw SemanticError("Error during evaluation: invalid bins option to density-plot");
+      }
+      bins = std::floor(value.asNumber());
     }
-
-    else if (it->tailConstBegin()->head().asSymbol() == "\"ordinate-label\"") {
-      text = Expression((it->tailConstEnd() - 1)->head().asSymbol());
-      text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-      text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-      text.set_property(Atom("\"text-rotation\""), Expression(Atom(-std::atan2(0, -1) / 2)));
-      point.append(Atom(left - 3));
-      point.append(Atom(-1 * (((upper - lower) / 2) + lower)));
-      text.set_property(Atom("\"position\""), point);
-      result.append(text);
+    else if (key == "\"text-scale\"") {
+      text_scale = value.asNumber();
     }
   }
 
-  std::ostringstream out;
-  out.precision(2);
+  // Extract the data once, then determine max and min x and y values for plot
+  std::vector<double> xs, ys;
+  xs.reserve(data.tailSize());
+  ys.reserve(data.tailSize());
 
-  point = resetPoint;
-  out.str("");
-  out << y_max;
-  text = Expression(Atom(out.str()));
-  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-  text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-  point.append(Atom(left - 2));
-  point.append(Atom(-upper));
-  text.set_property(Atom("\"position\""), point);
-  result.append(text);
-
-  point = resetPoint;
-  out.str("");
-  out << y_min;
-  text = Expression(Atom(out.str()));
-  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-  text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-  point.append(Atom(left - 2));
-  point.append(Atom(-lower));
-  text.set_property(Atom("\"position\""), point);
-  result.append(text);
-
-  point = resetPoint;
-  out.str("");
-  out << x_max;
-  text = Expression(Atom(out.str()));
-  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-  text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-  point.append(Atom(right));
-  point.append(Atom(-lower + 2));
-  text.set_property(Atom("\"position\""), point);
-  result.append(text);
-
-  point = resetPoint;
-  out.str("");
-  out << x_min;
-  text = Expression(Atom(out.str()));
-  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-  text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-  point.append(Atom(left));
-  point.append(Atom(-lower + 2));
-  text.set_property(Atom("\"position\""), point);
-  result.append(text);
-  
+  for(int i = 0; i < data.tailSize(); ++i){
+    Expression datum = data.tailAt(i);
+    xs.push_back(datum.tailAt(0).head().asNumber());
+    ys.push_back(datum.tailAt(1).head().asNumber());
+  }
 
-  return result;
+  min_max(xs, x_min, x_max);
+  min_max(ys, y_min, y_max);
+
+  double right, left, upper, lower;
+
+  double x_coeff = 20 / (x_max - x_min);
+  double y_coeff = 20 / (y_max - y_min);
+
+  right = x_max * x_coeff;
+  left = x_min * x_coeff;
+  upper = y_max * y_coeff;
+  lower = y_min * y_coeff;
+
+  // the counts fill the plot area, drawn first so the frame lies on top
+  std::size_t grid = static_cast<std::size_t>(bins);
+  auto plot = std::make_shared<PlotData>();
+  plot->view = PlotData::layout_view(x_min, x_max, y_min, y_max);
+  PlotStream stream(env.plot_sink(*this), *plot);
+  plot->set_data_space(true);
+  plot->add_image(x_min, y_max, x_max - x_min, y_max - y_min, grid, grid,
+    bin_density(xs, ys, x_min, x_max, y_min, y_max, grid, grid));
+  plot->set_data_space(false);
+
+  add_plot_frame(*plot, left, right, upper, lower, x_min, y_min);
+  add_plot_labels(*plot, m_tail[1], text_scale, left, right, upper, lower);
+  add_bound_labels(*plot, x_min, x_max, y_min, y_max, text_scale, left, right, upper, lower);
+
+  stream.finish();
+  return make_plot(plot);
 }
 
-Expression Expression::handle_continuous_plot(Environment & env){
-  Expression initial;
-  Expression result(Atom("list"));
-  result.set_property(Atom("\"discrete-plot\""), Expression(Atom("\"true\"")));
+// true if the expression contains a define special-form anywhere
+bool contains_define(const Expression & exp){
+  if (exp.head().isSymbol() && exp.head().asSymbol() == "define") return true;
 
-  double x_min, y_min, x_max, y_max, x_val, y_val;
-  double text_scale = 1;
-  
-  Expression resetLine(Atom("list")), line, left_bound, right_bound, upper_bound, lower_bound, ordinate_cross, abscissa_cross;
-  resetLine.set_property(Atom("\"object-name\""), Expression(Atom("\"line\"")));
-  resetLine.set_property(Atom("\"thickness\""), Expression(Atom(0)));
-  left_bound = right_bound = upper_bound = lower_bound = ordinate_cross = abscissa_cross = line = resetLine;
+  for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it) {
+    if (contains_define(*it)) return true;
+  }
+  return false;
+}
+
+// number of samples below which a batch is evaluated on the calling thread
+const std::size_t SAMPLE_GRAIN = 256;
+
+// evaluate lambda at sample i of every argument array, for each i
+std::vector<double> evaluate_samples(const Expression & lambda, const std::vector<const std::vector<double> *> & args,
+  const Environment & env){
+
+  Expression params = *lambda.tailConstBegin();
+  Expression body = *(lambda.tailConstBegin() + 1);
+
+  if (params.tailSize() != static_cast<int>(args.size())) {
+    throw SemanticError("Error in call to lambda procedure: invalid number of arguments");
+  }
+  std::vector<Atom> names;
+  for (auto it = params.tailConstBegin(); it != params.tailConstEnd(); ++it) {
+    names.push_back(it->head());
+  }
+
+  std::vector<double> ys(args[0]->size());
+
+  // each thread evaluates a contiguous run of samples with its own copy of
+  // the environment, so the caller's environment and the body are only read.
+  // One shadow environment serves a whole run unless the body can define
+  // symbols, which must not leak from one sample into the next
+  bool fresh = contains_define(body);
+
+  parallel_for(ys.size(), SAMPLE_GRAIN, [&](std::size_t begin, std::size_t end){
+    Environment shadow = env;
+
+    for (std::size_t i = begin; i < end; ++i) {
+      if (fresh) shadow = env;
+      for (std::size_t a = 0; a < names.size(); ++a) {
+        shadow.add_exp(names[a], Expression((*args[a])[i]));
+      }
+      ys[i] = Expression(body).eval(shadow).head().asNumber();
+    }
+  });
+
+  return ys;
+}
+
+std::vector<double> evaluate_lambda(const Expression & lambda, const std::vector<double> & xs, const Environment & env){
+  return evaluate_samples(lambda, {&xs}, env);
+}
+
+std::vector<double> evaluate_lambda(const Expression & lambda, const std::vector<double> & xs,
+  const std::vector<double> & ys, const Environment & env){
+  return evaluate_samples(lambda, {&xs, &ys}, env);
+}
+
+/*
+Adaptive sampling for continuous-plot. Starts from min_samples uniform samples
+of f over [x_min, x_max], then repeatedly splits the two segments adjacent to
+any sample where the curve bends by more than tolerance degrees, sampling f
+at the segment midpoints. Angles are measured with both axes normalized to
+the current plot bounds, as they will be drawn. Stops after 10 rounds, when
+no segment needs splitting or when max_samples is reached.
+ */
+void sample_adaptive(const std::function<std::vector<double>(const std::vector<double> &)> & f,
+  double x_min, double x_max,
+  std::size_t min_samples, std::size_t max_samples, double tolerance,
+  std::vector<double> & xs, std::vector<double> & ys){
+
+  const double PI = std::atan2(0, -1);
+  const double limit = PI - tolerance * PI / 180;
+
+  xs.clear();
+  for(std::size_t i = 0; i < min_samples; ++i){
+    xs.push_back((i == min_samples - 1) ? x_max : x_min + i * (x_max - x_min) / (min_samples - 1));
+  }
+  ys = f(xs);
+
+  for(int round = 0; round < 10 && xs.size() < max_samples; ++round){
+
+    double y_min = ys[0], y_max = ys[0];
+    for(auto y : ys){
+      if(y < y_min) y_min = y;
+      if(y > y_max) y_max = y;
+    }
+    double x_scale = 1 / (x_max - x_min);
+    double y_scale = (y_max > y_min) ? 1 / (y_max - y_min) : 1;
+
+    // mark segments on either side of a sharp bend
+    std::vector<bool> split(xs.size() - 1, false);
+    bool any = false;
+    for(std::size_t i = 1; i + 1 < xs.size(); ++i){
+      double ax = (xs[i - 1] - xs[i]) * x_scale, ay = (ys[i - 1] - ys[i]) * y_scale;
+      double bx = (xs[i + 1] - xs[i]) * x_scale, by = (ys[i + 1] - ys[i]) * y_scale;
+      double angle = std::atan2(std::abs(ax * by - ay * bx), ax * bx + ay * by);
+
+      if(angle < limit){
+        split[i - 1] = split[i] = true;
+        any = true;
+      }
+    }
+    if(!any) break;
+
+    // sample all midpoints of this round in one batch
+    std::size_t budget = max_samples - xs.size();
+    std::vector<double> mid_xs;
+    for(std::size_t i = 0; i + 1 < xs.size() && mid_xs.size() < budget; ++i){
+      if(split[i]) mid_xs.push_back((xs[i] + xs[i + 1]) / 2);
+    }
+    std::vector<double> mid_ys = f(mid_xs);
+
+    std::vector<double> new_xs, new_ys;
+    std::size_t next = 0;
+    for(std::size_t i = 0; i + 1 < xs.size(); ++i){
+      new_xs.push_back(xs[i]);
+      new_ys.push_back(ys[i]);
+
+      if(next < mid_xs.size() && mid_xs[next] > xs[i] && mid_xs[next] < xs[i + 1]){
+        new_xs.push_back(mid_xs[next]);
+        new_ys.push_back(mid_ys[next]);
+        ++next;
+      }
+    }
+    new_xs.push_back(xs.back());
+    new_ys.push_back(ys.back());
 
-  Expression resetPoint(Atom("list")), point, pointA, pointB;
-  resetPoint.set_property(Atom("\"object-name\""), Expression(Atom("\"point\"")));
-  resetPoint.set_property(Atom("\"size\""), Expression(Atom(0.5)));
-  pointA = pointB = point = resetPoint;
+    xs.swap(new_xs);
+    ys.swap(new_ys);
+  }
+}
 
-  Expression text;
+Expression Expression::handle_continuous_plot(Environment & env){
 
+  double x_min, y_min, x_max, y_max;
+  double text_scale = 1;
 
   // tail must have size 2 or 3 or error
   if(m_tail.size() != 2 && m_tail.size() != 3){
     throw SemanticError("Error during evaluation: invalid number of arguments to continuous-plot");
   }
   
-  // tail[0] must contain a lambda function
-  if (env.get_exp(m_tail[0].head()).head().asSymbol() != "lambda") {
+  // tail[0] must contain a lambda function, or a list of them to plot as series
+  // (list f g ...) is read from the unevaluated argument, since list does not
+  // hold procedures
+  std::vector<Expression> lambdas;
+  if (m_tail[0].isList()) {
+    for(auto it = m_tail[0].tailConstBegin(); it != m_tail[0].tailConstEnd(); ++it){
+      lambdas.push_back(Expression(*it).eval(env));
+    }
+  }
+  else {
+    lambdas.push_back(m_tail[0].eval(env));
+  }
+
+  for(auto & lambda : lambdas){
+    if (!lambda.isLambda()) {
+      throw SemanticError("Error during evaluation: first argument to continuous-plot not a lambda function");
+    }
+  }
+  if (lambdas.empty()) {
     throw SemanticError("Error during evaluation: first argument to continuous-plot not a lambda function");
   }
 
@@ -600,36 +865,81 @@ Expression Expression::handle_continuous_plot(Environment & env){
 
 
 
- Expression x_values = m_tail[1].eval(env);
- Expression proc(m_tail[0].head().asSymbol());
- Expression y_values;
- Expression temp;
+  // Find sampling options if any, 50 uniform intervals unless adaptive
+  bool adaptive = false;
+  double min_samples = 10, max_samples = 1000, angle_tolerance = 5;
+
+  if (m_tail.size() == 3) {
+    for(auto it = m_tail[2].tailConstBegin(); it != m_tail[2].tailConstEnd(); ++it){
+      std::string key = it->tailConstBegin()->head().asSymbol();
+      const Atom & value = (it->tailConstEnd() - 1)->head();
+
+      if (key == "\"sampling\"") adaptive = (value.asSymbol() == "\"adaptive\"");
+      else if (key == "\"min-samples\"" || key == "\"max-samples\"") {
+        // sample counts are whole numbers of at least one
+        if (!value.isNumber() || value.asNumber() < 1 || value.asNumber() != std::floor(value.asNumber())) {
+          throw SemanticError("Error during evaluation: invalid sampling options to continuous-plot");
+        }
+        if (key == "\"min-samples\"") min_samples = value.asNumber();
+        else max_samples = value.asNumber();
+      }
+      else if (key == "\"angle-tolerance\"") {
+        if (!value.isNumber()) {
+          throw SemanticError("Error during evaluation: invalid sampling options to continuous-plot");
+        }
+        angle_tolerance = value.asNumber();
+      }
+    }
+  }
 
- x_min = x_values.m_tail[0].head().asNumber();
- x_max = x_values.m_tail[1].head().asNumber();
+  if (adaptive && (min_samples < 2 || max_samples < min_samples || angle_tolerance < 0)) {
+    throw SemanticError("Error during evaluation: invalid sampling options to continuous-plot");
+  }
 
- double inc_val = (x_max - x_min) / 50.0;
+ Expression x_values = m_tail[1].eval(env);
 
-   // Find y values
-  for(double i = x_min; i < x_max + inc_val; i += inc_val){
+ x_min = x_values.tailAt(0).head().asNumber();
+ x_max = x_values.tailAt(1).head().asNumber();
 
-    temp = proc;
-    x_val = i;
-    temp.append(x_val);
-    y_val = temp.eval(env).head().asNumber();
+  if (!(x_min < x_max)) {
+    throw SemanticError("Error during evaluation: second argument to continuous-plot not an increasing range");
+  }
 
-    y_values.append(y_val);
+  // every sample of every series is evaluated exactly once, in batches, into
+  // packed x/y buffers, series after series
+  std::vector<double> xs, ys;
+  std::vector<std::size_t> starts;
+
+  std::vector<double> uniform;
+  if (!adaptive) {
+    // 50 uniform intervals, the last sample closes the final interval
+    double inc_val = (x_max - x_min) / SAMPLER_BASE_INTERVALS;
+    for(double i = x_min; i < x_max; i += inc_val){
+      uniform.push_back(i);
+    }
+    uniform.push_back(uniform.back() + inc_val);
   }
 
- // Determine max and min y values for plot
-  y_min = y_max = y_values.m_tail[0].head().asNumber();
+  for(auto & lambda : lambdas){
+    auto sample = [&](const std::vector<double> & x){ return evaluate_lambda(lambda, x, env); };
+    std::vector<double> sx, sy;
 
-  for(unsigned i = 0; i < y_values.m_tail.size(); ++i){
-    y_val = y_values.m_tail[i].head().asNumber();
-     
-    if (y_min > y_val) y_min = y_val;
-    else if (y_max < y_val) y_max = y_val; 
+    if (adaptive) {
+      sample_adaptive(sample, x_min, x_max, min_samples, max_samples, angle_tolerance, sx, sy);
+    }
+    else {
+      sx = uniform;
+      sy = sample(sx);
+    }
+
+    starts.push_back(xs.size());
+    xs.insert(xs.end(), sx.begin(), sx.end());
+    ys.insert(ys.end(), sy.begin(), sy.end());
   }
+  starts.push_back(xs.size());
+
+ // Determine max and min y values over all series for plot
+  min_max(ys, y_min, y_max);
 
   // Create all lines necessary for plot
   double right, left, upper, lower;
@@ -642,116 +952,29 @@ Expression Expression::handle_continuous_plot(Environment & env){
   upper = y_max * y_coeff;
   lower = y_min * y_coeff;
 
- 
-  double x_valNext, y_valNext;
-
-  // Make all lines
-  for(double i = x_min; i < x_max; i += inc_val){
-   
-    pointA = pointB = resetPoint;
-    line = resetLine;
-
-    temp = proc;
-    x_val = i;
-    temp.append(x_val);
-    y_val = temp.eval(env).head().asNumber();
-
-    temp = proc;
-    x_valNext = x_val + inc_val;
-    temp.append(x_valNext);
-    y_valNext = temp.eval(env).head().asNumber();
-
-    // scale
-    if (x_val >= 0) x_val *= (right / x_max);
-    else x_val *= (std::abs(left) / std::abs(x_min));
- 
-    // y-axis inverted in view
-    if (y_val >= 0) y_val *= (upper / y_max) * -1;
-    else y_val = y_val * (std::abs(lower) / std::abs(y_min)) * -1;
+  // the samples are placed in view by scaling, y-axis inverted in view
+  auto plot = std::make_shared<PlotData>();
+  plot->view = PlotData::layout_view(x_min, x_max, y_min, y_max);
 
-    // scale
-    if (x_valNext >= 0) x_valNext *= (right / x_max);
-    else x_valNext *= (std::abs(left) / std::abs(x_min));
- 
-    // y-axis inverted in view
-    if (y_valNext >= 0) y_valNext *= (upper / y_max) * -1;
-    else y_valNext = y_valNext * (std::abs(lower) / std::abs(y_min)) * -1;
-
-    pointA.append(x_val);
-    pointA.append(y_val);
-    line.append(pointA);
-    pointB.append(x_valNext);
-    pointB.append(y_valNext);
-    line.append(pointB);
-    result.append(line);
-
-  }
-
-  // make left bound line
-  pointA = pointB = resetPoint;
-  pointA.append(left);
-  pointA.append(-upper);
-  left_bound.append(pointA);
-  pointB.append(left);
-  pointB.append(-lower);
-  left_bound.append(pointB);
-  result.append(left_bound);
-  pointA = pointB = resetPoint;
-
-  // make right bound line
-  pointA.append(right);
-  pointA.append(-upper);
-  right_bound.append(pointA);
-  pointB.append(right);
-  pointB.append(-lower);
-  right_bound.append(pointB);
-  result.append(right_bound);
-  pointA = pointB = resetPoint;
-
-  // make lower bound line (inverted in view)
-  pointA.append(left);
-  pointA.append(-lower);
-  upper_bound.append(pointA);
-  pointB.append(right);
-  pointB.append(-lower);
-  upper_bound.append(pointB);
-  result.append(upper_bound);
-  pointA = pointB = resetPoint;
-
-  // make upper bound line (inverted in view)
-  pointA.append(left);
-  pointA.append(-upper);
-  lower_bound.append(pointA);
-  pointB.append(right);
-  pointB.append(-upper);
-  lower_bound.append(pointB);
-  result.append(lower_bound);
-  pointA = pointB = resetPoint;
-
-  // make ordinate cross line
-  if (x_min < 0) {
-    pointA.append(0);
-    pointA.append(-upper);
-    ordinate_cross.append(pointA);
-    pointB.append(0);
-    pointB.append(-lower);
-    ordinate_cross.append(pointB);
-    result.append(ordinate_cross);
-    pointA = pointB = resetPoint;
-  }
-
-  // make abscissa cross line
-  if (y_min < 0) {
-    pointA.append(left);
-    pointA.append(0);
-    abscissa_cross.append(pointA);
-    pointB.append(right);
-    pointB.append(0);
-    abscissa_cross.append(pointB);
-    result.append(abscissa_cross);
-  }
-
-// Find text scaling value if any
+  // the curves are kept so a front end zooming in can have them sampled again
+  if (SamplerRegistry * registry = env.sampler_registry()) {
+    plot->sampler = registry->add(lambdas, x_min, x_max, plot->view);
+  }
+  PlotStream stream(env.plot_sink(*this), *plot);
+
+  // Make all lines between consecutive samples of each series, in data coordinates
+  for(std::size_t s = 0; s + 1 < starts.size(); ++s){
+    plot->begin_series();
+    for(std::size_t i = starts[s]; i + 1 < starts[s + 1]; ++i){
+      plot->add_line(xs[i], ys[i], xs[i + 1], ys[i + 1], PLOT_LINE_THICKNESS);
+      stream.flush();
+    }
+    plot->end_series();
+  }
+
+  add_plot_frame(*plot, left, right, upper, lower, x_min, y_min);
+
+  // Find text scaling value if any
   if (m_tail.size() == 3) {
     for(auto it = m_tail[2].tailConstBegin(); it != m_tail[2].tailConstEnd(); ++it){
       if (it->tailConstBegin()->head().asSymbol() == "text-scale") {
@@ -759,101 +982,262 @@ Expression Expression::handle_continuous_plot(Environment & env){
       }
     }
 
-    for(auto it = m_tail[2].tailConstBegin(); it != m_tail[2].tailConstEnd(); ++it){
-      point = resetPoint;
-      point.set_property(Atom("\"size\""), Expression(Atom(0)));
-
-      if (it->tailConstBegin()->head().asSymbol() == "\"title\"") {
-        text = Expression((it->tailConstEnd() - 1)->head().asSymbol());
-        text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-        text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-        point.append(Atom(((right - left) / 2) + left));
-        point.append(Atom(-upper - 3));
-        text.set_property(Atom("\"position\""), point);
-        result.append(text);
+    add_plot_labels(*plot, m_tail[2], text_scale, left, right, upper, lower);
+  }
+
+  add_bound_labels(*plot, x_min, x_max, y_min, y_max, text_scale, left, right, upper, lower);
+
+  stream.finish();
+  return make_plot(plot);
+}
+
+
+// heatmap-plot and contour-plot share their arguments: a two parameter
+// lambda, the x and y ranges, and an optional options list
+Expression Expression::handle_field_plot(Environment & env, bool contour){
+
+  std::string name = contour ? "contour-plot" : "heatmap-plot";
+  double text_scale = 1;
+
+  // tail must have size 3 or 4 or error
+  if(m_tail.size() != 3 && m_tail.size() != 4){
+    throw SemanticError("Error during evaluation: invalid number of arguments to " + name);
+  }
+
+  // tail[0] must contain a lambda function
+  Expression lambda = m_tail[0].eval(env);
+  if (!lambda.isLambda()) {
+    throw SemanticError("Error during evaluation: first argument to " + name + " not a lambda function");
+  }
+
+  // tail[1] and tail[2] must contain lists of two bounds
+  if (!m_tail[1].isList() || m_tail[1].m_tail.size() != 2) {
+    throw SemanticError("Error during evaluation: second argument to " + name + " not a list or incorrect number of items in list");
+  }
+  if (!m_tail[2].isList() || m_tail[2].m_tail.size() != 2) {
+    throw SemanticError("Error during evaluation: third argument to " + name + " not a list or incorrect number of items in list");
+  }
+
+  // tail[3] must contain a list
+  if (m_tail.size() == 4 && !m_tail[3].isList()) {
+    throw SemanticError("Error during evaluation: fourth argument to " + name + " not a list");
+  }
+
+  Expression x_values = m_tail[1].eval(env);
+  Expression y_values = m_tail[2].eval(env);
+
+  double x_min = x_values.tailAt(0).head().asNumber();
+  double x_max = x_values.tailAt(1).head().asNumber();
+  double y_min = y_values.tailAt(0).head().asNumber();
+  double y_max = y_values.tailAt(1).head().asNumber();
+
+  if (!(x_min < x_max)) {
+    throw SemanticError("Error during evaluation: second argument to " + name + " not an increasing range");
+  }
+  if (!(y_min < y_max)) {
+    throw SemanticError("Error during evaluation: third argument to " + name + " not an increasing range");
+  }
+
+  // Find the grid size, contour levels and text scaling value if any
+  double grid_option = PLOT_FIELD_GRID, levels_option = PLOT_CONTOUR_LEVELS;
+  Expression options(Atom("list"));
+
+  if (m_tail.size() == 4) {
+    options = m_tail[3];
+    for(auto it = options.tailConstBegin(); it != options.tailConstEnd(); ++it){
+      std::string key = it->tailConstBegin()->head().asSymbol();
+      const Atom & value = (it->tailConstEnd() - 1)->head();
+
+      if (key == "\"grid\"") {
+        if (!value.isNumber() || value.asNumber() < 2 || value.asNumber() > PLOT_FIELD_MAX_GRID) {
+          throw SemanticError("Error during evaluation: invalid grid option to " + name);
+        }
+        grid_option = std::floor(value.asNumber());
+      }
+      else if (key == "\"levels\"" && contour) {
+        if (!value.isNumber() || value.asNumber() < 1 || value.asNumber() > PLOT_CONTOUR_MAX_LEVELS) {
+          throw SemanticError("Error during evaluation: invalid levels option to " + name);
+        }
+        levels_option = std::floor(value.asNumber());
+      }
+      else if (key == "\"text-scale\"") {
+        text_scale = value.asNumber();
+      }
+    }
+  }
+
+  // a heatmap samples the center of each cell, a contour plot the nodes
+  // between cells, row 0 at y_max. All samples go to the lambda in one batch,
+  // which evaluates them across threads in bands of rows
+  std::size_t grid = static_cast<std::size_t>(grid_option);
+  double dx = (x_max - x_min) / (contour ? grid - 1 : grid);
+  double dy = (y_max - y_min) / (contour ? grid - 1 : grid);
+  double offset = contour ? 0 : 0.5;
+
+  std::vector<double> xs, ys;
+  xs.reserve(grid * grid);
+  ys.reserve(grid * grid);
+  for(std::size_t r = 0; r < grid; ++r){
+    for(std::size_t c = 0; c < grid; ++c){
+      xs.push_back(x_min + (c + offset) * dx);
+      ys.push_back(y_max - (r + offset) * dy);
+    }
+  }
+  std::vector<double> values = evaluate_lambda(lambda, xs, ys, env);
+
+  double right, left, upper, lower;
+
+  double x_coeff = 20 / (x_max - x_min);
+  double y_coeff = 20 / (y_max - y_min);
+
+  right = x_max * x_coeff;
+  left = x_min * x_coeff;
+  upper = y_max * y_coeff;
+  lower = y_min * y_coeff;
+
+  auto plot = std::make_shared<PlotData>();
+  plot->view = PlotData::layout_view(x_min, x_max, y_min, y_max);
+  PlotStream stream(env.plot_sink(*this), *plot);
+
+  if (!contour) {
+    // the values fill the plot area, drawn first so the frame lies on top
+    plot->set_data_space(true);
+    plot->add_image(x_min, y_max, x_max - x_min, y_max - y_min, grid, grid, std::move(values), PlotData::LINEAR);
+    plot->set_data_space(false);
+  }
+  else {
+    // levels evenly spaced strictly between the smallest and largest value,
+    // each traced independently and drawn as one series
+    double v_min, v_max;
+    min_max(values, v_min, v_max);
+
+    std::size_t levels = (v_min < v_max) ? static_cast<std::size_t>(levels_option) : 0;
+    std::vector<std::vector<double>> line_xs(levels), line_ys(levels);
+    std::vector<std::vector<std::size_t>> line_starts(levels);
+
+    parallel_for(levels, 1, [&](std::size_t begin, std::size_t end){
+      for(std::size_t k = begin; k < end; ++k){
+        double level = v_min + (k + 1) * (v_max - v_min) / (levels + 1);
+        march_squares(values, grid, grid, level, line_xs[k], line_ys[k], line_starts[k]);
       }
+    });
+
+    for(std::size_t k = 0; k < levels; ++k){
+      std::vector<double> & lx = line_xs[k];
+      std::vector<double> & ly = line_ys[k];
 
-      else if (it->tailConstBegin()->head().asSymbol() == "\"abscissa-label\"") {
-        text = Expression((it->tailConstEnd() - 1)->head().asSymbol());
-        text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-        text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-        point.append(Atom(((right - left) / 2) + left));
-        point.append(Atom(-lower + 3));
-        text.set_property(Atom("\"position\""), point);
-        result.append(text);
+      // node columns and rows to data coordinates
+      for(std::size_t i = 0; i < lx.size(); ++i){
+        lx[i] = x_min + lx[i] * dx;
+        ly[i] = y_max - ly[i] * dy;
       }
 
-      else if (it->tailConstBegin()->head().asSymbol() == "\"ordinate-label\"") {
-        text = Expression((it->tailConstEnd() - 1)->head().asSymbol());
-        text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-        text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-        text.set_property(Atom("\"text-rotation\""), Expression(Atom(-std::atan2(0, -1) / 2)));
-        point.append(Atom(left - 3));
-        point.append(Atom(-1 * (((upper - lower) / 2) + lower)));
-        text.set_property(Atom("\"position\""), point);
-        result.append(text);
+      plot->begin_series();
+      std::vector<std::size_t> & starts = line_starts[k];
+      for(std::size_t l = 0; l < starts.size(); ++l){
+        std::size_t stop = (l + 1 < starts.size()) ? starts[l + 1] : lx.size();
+        plot->add_polyline(lx, ly, starts[l], stop - starts[l], PLOT_LINE_THICKNESS);
+        stream.flush();
       }
+      plot->end_series();
     }
   }
 
-  std::ostringstream out;
-  out.precision(2);
+  add_plot_frame(*plot, left, right, upper, lower, x_min, y_min);
+  add_plot_labels(*plot, options, text_scale, left, right, upper, lower);
+  add_bound_labels(*plot, x_min, x_max, y_min, y_max, text_scale, left, right, upper, lower);
 
-  point = resetPoint;
-  out.str("");
-  out << y_max;
-  text = Expression(Atom(out.str()));
-  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-  text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-  point.append(Atom(left - 2));
-  point.append(Atom(-upper));
-  text.set_property(Atom("\"position\""), point);
-  result.append(text);
-
-  point = resetPoint;
-  out.str("");
-  out << y_min;
-  text = Expression(Atom(out.str()));
-  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-  text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-  point.append(Atom(left - 2));
-  point.append(Atom(-lower));
-  text.set_property(Atom("\"position\""), point);
-  result.append(text);
-
-  point = resetPoint;
-  out.str("");
-  out << x_max;
-  text = Expression(Atom(out.str()));
-  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-  text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-  point.append(Atom(right));
-  point.append(Atom(-lower + 2));
-  text.set_property(Atom("\"position\""), point);
-  result.append(text);
-
-  point = resetPoint;
-  out.str("");
-  out << x_min;
-  text = Expression(Atom(out.str()));
-  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
-  text.set_property(Atom("\"text-scale\""), Expression(Atom(text_scale)));
-  point.append(Atom(left));
-  point.append(Atom(-lower + 2));
-  text.set_property(Atom("\"position\""), point);
-  result.append(text);
- 
-  return result;
+  stream.finish();
+  return make_plot(plot);
 }
 
+// evaluate a single argument procedure (built-in or lambda) named by proc
+Expression call_procedure(const Atom & proc, const Expression & arg, Environment & env){
+  Expression temp(proc);
+  temp.append(arg);
+  return temp.eval(env);
+}
+
+// Chains of map and filter calls, e.g. (map f (filter p (map g src))), are
+// collected into a list of stages and run element by element over src, so no
+// intermediate list is built between stages. plotscript procedures cannot
+// change the environment they are called from (lambda defines go into a
+// shadow environment), so running the stages interleaved gives the same
+// result as running them one after another.
+Expression Expression::handle_pipeline(Environment & env){
+
+  // stages from innermost to outermost
+  std::vector<std::pair<bool, Atom>> stages;
+  Expression * node = this;
+
+  while (node->m_head.isSymbol() &&
+    (node->m_head.asSymbol() == "map" || node->m_head.asSymbol() == "filter")) {
+
+    std::string name = node->m_head.asSymbol();
+
+    if (node->m_tail.size() != 2) {
+      throw SemanticError("Error in call to " + name + ": invalid number of arguments");
+    }
+
+    const Expression & proc = node->m_tail[0];
+    if (!((env.is_proc(proc.head()) && (proc.tailConstBegin() == proc.tailConstEnd())) ||
+      env.get_exp(proc.head()).head().asSymbol() == "lambda")) {
+      throw SemanticError("Error in call to " + name + ": first argument not a procedure");
+    }
+
+    stages.insert(stages.begin(), std::make_pair(name == "filter", proc.head()));
+    node = &node->m_tail[1];
+  }
+
+  // the innermost stage names the source list
+  std::string source_name = stages.front().first ? "filter" : "map";
+  Expression args = node->eval(env);
+  if (!(node->isList() || (args.isList() && args.tailSize() != 0))) {
+    throw SemanticError("Error in call to " + source_name + ": second argument not a list");
+  }
+
+  Expression result(Atom("list"));
+
+  for (int i = 0; i < args.tailSize(); ++i) {
+    Expression value = args.tailAt(i);
+    bool keep = true;
+
+    for (auto & stage : stages) {
+      if (stage.first) {
+        // filter keeps elements whose predicate is a non-zero number
+        Expression test = call_procedure(stage.second, value, env);
+        if (!test.isHeadNumber()) {
+          throw SemanticError("Error in call to filter: predicate did not return a number");
+        }
+        keep = (test.head().asNumber() != 0);
+      }
+      else {
+        value = call_procedure(stage.second, value, env);
+      }
+
+      if (!keep) break;
+    }
+
+    if (keep) result.append(value);
+  }
+
+  return result;
+}
 
 // this is a simple recursive version. the iterative version is more
 // difficult with the ast data structure used (no parent pointer).
 // this limits the practical depth of our AST
 Expression Expression::eval(Environment & env) {
 
+  // stop here if the front end interrupted the evaluation or it ran over budget
+  if (Interrupt * interrupt = env.interrupt()) interrupt->step();
+
+  // sequence-backed lists are values and evaluate to themselves
+  if (m_seq) {
+    return *this;
+  }
   // lookup only if tail is empty and the head is not list
-  if (m_tail.empty() && m_head.asSymbol() != "list") {
+  else if (m_tail.empty() && m_head.asSymbol() != "list") {
     return handle_lookup(m_head, env);
   }
   // handle begin special-form
@@ -884,6 +1268,18 @@ Expression Expression::eval(Environment & env) {
   else if (m_head.isSymbol() && m_head.asSymbol() == "continuous-plot") {
     return handle_continuous_plot(env);
   }
+  // handle density-plot special procedure
+  else if (m_head.isSymbol() && m_head.asSymbol() == "density-plot") {
+    return handle_density_plot(env);
+  }
+  // handle heatmap-plot special procedure
+  else if (m_head.isSymbol() && m_head.asSymbol() == "heatmap-plot") {
+    return handle_field_plot(env, false);
+  }
+  // handle contour-plot special procedure
+  else if (m_head.isSymbol() && m_head.asSymbol() == "contour-plot") {
+    return handle_field_plot(env, true);
+  }
   // else attempt to treat as procedure
   else {
     std::vector<Expression> results;
@@ -913,7 +1309,10 @@ Expression Expression::eval(Environment & env) {
         Expression result = proc.eval(shadow);
 
         // copy over properties from overall lambda to result if any
-        if (!env.get_exp(m_head).propmap.empty()) result.propmap = env.get_exp(m_head).propmap;
+        if (!env.get_exp(m_head).propmap.empty()){
+          result.propmap = env.get_exp(m_head).propmap;
+          result.m_kind = env.get_exp(m_head).m_kind;
+        }
 
         return result;
         }
@@ -946,34 +1345,55 @@ Expression Expression::eval(Environment & env) {
         }
       }
 
-    // map procedure -----------------------------------------------------------------------------------
-    else if (m_head.isSymbol() && m_head.asSymbol() == "map") {
+    // map and filter procedures, fused into a single pass ------------------------------------------------
+    else if (m_head.isSymbol() && (m_head.asSymbol() == "map" || m_head.asSymbol() == "filter")) {
+      return handle_pipeline(env);
+    }
+
+    // sort-by procedure -----------------------------------------------------------------------------------
+    else if (m_head.isSymbol() && m_head.asSymbol() == "sort-by") {
 
       // preconditions
-      if ((env.is_proc(m_tail[0].head()) && (m_tail[0].tailConstBegin() == m_tail[0].tailConstEnd())) ||
-        env.get_exp(m_tail[0].head()).head().asSymbol() == "lambda") {
+      if (m_tail.size() != 2) {
+        throw SemanticError("Error in call to sort-by: invalid number of arguments");
+      }
+      if (!((env.is_proc(m_tail[0].head()) && (m_tail[0].tailConstBegin() == m_tail[0].tailConstEnd())) ||
+        env.get_exp(m_tail[0].head()).head().asSymbol() == "lambda")) {
+        throw SemanticError("Error in call to sort-by: first argument not a procedure");
+      }
 
-        // evaluate each argument according to procedure and place in result list
-        Atom proc = m_tail[0].head();
-        Expression args = m_tail[1].eval(env);
-        Expression result(Atom("list"));
+      Atom proc = m_tail[0].head();
+      Expression args = m_tail[1].eval(env);
 
-        for (auto it = args.tailConstBegin(); it != args.tailConstEnd(); ++it) {
-          Expression temp(proc);
-          temp.append(*it);
-          result.append(temp.eval(env));
+      if (!args.isList()) {
+        throw SemanticError("Error in call to sort-by: second argument not a list");
+      }
+
+      // evaluate the key of each element once
+      std::vector<double> keys;
+      keys.reserve(args.tailSize());
+      for (int i = 0; i < args.tailSize(); ++i) {
+        Expression key = call_procedure(proc, args.tailAt(i), env);
+        if (!key.isHeadNumber()) {
+          throw SemanticError("Error in call to sort-by: key procedure did not return a number");
         }
-        
-        if (m_tail[1].isList() || (args.isList() && args.tailConstBegin() != args.tailConstEnd())) {
-          return result;
-        }
-        else {
-          throw SemanticError("Error in call to map: second argument not a list");
+        if (std::isnan(key.head().asNumber())) {
+          throw SemanticError("Error in call to sort-by: key procedure returned NaN");
         }
+        keys.push_back(key.head().asNumber());
       }
-      else {
-        throw SemanticError("Error in call to map: first argument not a procedure");
+
+      // stable sort of element positions by key, equal keys keep list order
+      std::vector<std::size_t> order(keys.size());
+      for (std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+      parallel_sort(order.begin(), order.end(), [&keys](std::size_t a, std::size_t b){ return keys[a] < keys[b]; });
+
+      Expression result(Atom("list"));
+      for (auto i : order) {
+        result.append(args.tailAt(i));
       }
+
+      return result;
     }
 
     // basic procedures -----------------------------------------------------------------------------------
@@ -1008,9 +1428,10 @@ std::ostream & operator<<(std::ostream & out, const Expression & exp){
     if (exp.isHeadSymbol() && (exp.tailConstBegin() != exp.tailConstEnd())) out << " ";
   }
 
-  for(auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e){
-    out << *e;
-    if (e != exp.tailConstEnd() - 1) out << " ";
+  // sequence elements are produced one at a time while printing
+  for(int i = 0; i < exp.tailSize(); ++i){
+    if (i != 0) out << " ";
+    out << exp.tailAt(i);
   }
 
   if(!complex) out << ")";
@@ -1022,6 +1443,14 @@ bool Expression::operator==(const Expression & exp) const noexcept{
 
   bool result = (m_head == exp.m_head);
 
+  if(m_seq || exp.m_seq){
+    result = result && (tailSize() == exp.tailSize());
+    for(int i = 0; result && i < tailSize(); ++i){
+      result = (tailAt(i) == exp.tailAt(i));
+    }
+    return result;
+  }
+
   result = result && (m_tail.size() == exp.m_tail.size());
 
   if(result){
@@ -1035,6 +1464,34 @@ bool Expression::operator==(const Expression & exp) const noexcept{
   return result;
 }
 
+std::size_t Expression::hash() const noexcept{
+
+  std::size_t seed = 0;
+  if(m_head.isNumber()){
+    hash_combine(seed, m_head.asNumber());
+  }
+  else if(m_head.isComplex()){
+    hash_combine(seed, m_head.asComplex().real());
+    hash_combine(seed, m_head.asComplex().imag());
+  }
+  else{
+    hash_combine(seed, m_head.asSymbol());
+  }
+
+  int size = tailSize();
+  hash_combine(seed, size);
+  for(int i = 0; i < size; ++i){
+    hash_combine(seed, m_seq ? tailAt(i).hash() : m_tail[i].hash());
+  }
+
+  for(auto & property : propmap){
+    hash_combine(seed, property.first);
+    hash_combine(seed, property.second.hash());
+  }
+
+  return seed;
+}
+
 bool operator!=(const Expression & left, const Expression & right) noexcept{
 
   return !(left == right);
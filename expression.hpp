@@ -7,6 +7,7 @@ Defines the Expression type and assiciated functions.
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "token.hpp"
 #include "atom.hpp"
@@ -14,17 +15,26 @@ Defines the Expression type and assiciated functions.
 // forward declare Environment
 class Environment;
 
+// forward declare Sequence
+class Sequence;
+
 /*! \class Expression
 \brief An expression is a tree of Atoms.
 
 An expression is an atom called the head followed by a (possibly empty) 
 list of expressions called the tail.
+
+A list may instead be backed by a Sequence, in which case its elements are
+produced on demand by tailAt rather than stored in the tail.
  */
 class Expression {
 public:
 
   typedef std::vector<Expression>::const_iterator ConstIteratorType;
 
+  /// The graphics primitive an expression is, by its "object-name" property
+  enum ObjectKind { NONE, POINT, LINE, TEXT, IMAGE, POLYLINE, OTHER };
+
   /// Default construct and Expression, whose type in NoneType
   Expression();
 
@@ -33,6 +43,11 @@ public:
   */
   Expression(const Atom & a);
 
+  /*! Construct a list Expression whose elements come from a Sequence
+    \param seq the sequence providing the list elements
+  */
+  Expression(std::shared_ptr<const Sequence> seq);
+
   /// deep-copy construct an expression (recursive)
   Expression(const Expression & a);
 
@@ -60,8 +75,17 @@ public:
   /// return a const-iterator to the tail end
   ConstIteratorType tailConstEnd() const noexcept;
 
-  /// return tail length
-  int tailSize();
+  /// return tail length, or the number of elements in a sequence
+  int tailSize() const;
+
+  /// return a copy of the tail element at index, from the tail or the sequence
+  Expression tailAt(std::size_t index) const;
+
+  /// return tailAt(index).head().asNumber(), without copying a stored tail element
+  double numberAt(std::size_t index) const;
+
+  /// return the Sequence backing this list, or nullptr
+  std::shared_ptr<const Sequence> sequence() const noexcept;
 
   /// convienience member to determine if head atom is a number
   bool isHeadNumber() const noexcept;
@@ -72,9 +96,12 @@ public:
   /// convienience member to determine if head atom is complex
   bool isHeadComplex() const noexcept;
 
-  /// convienience member to determine if head atom is lambda
+  /// convienience member to determine if head atom is list
   bool isList() const noexcept;
 
+  /// convienience member to determine if the list is backed by a sequence
+  bool isSequence() const noexcept;
+
   /// convienience member to determine if head atom is lambda
   bool isLambda() const noexcept;
 
@@ -87,6 +114,9 @@ public:
   /// equality comparison for two expressions (recursive)
   bool operator==(const Expression & exp) const noexcept;
 
+  /// structural hash of the head, tail and properties (recursive), equal for equal expressions with equal properties
+  std::size_t hash() const noexcept;
+
   /*! Add a mapping from sym argument to the exp argument for the current expression.
     \param sym the symbol to add
     \param exp the expression the symbol should map to
@@ -98,6 +128,22 @@ public:
     \return the expression the symbol maps to or throw error for no property list
   */
   Expression get_property(const Atom &sym) const;
+
+  /*! Find a property without copying it.
+    \param key the property name, including the quotes of its string literal
+    \return the property, or nullptr if it is not set
+  */
+  const Expression * find_property(const std::string & key) const noexcept;
+
+  /*! Get a numeric property without copying it.
+    \param key the property name, including the quotes of its string literal
+    \param fallback the value of a property not set or not a number
+    \return the number the property heads, or fallback
+  */
+  double number_property(const std::string & key, double fallback) const noexcept;
+
+  /// the graphics primitive this is, kept up to date as the "object-name" property is set
+  ObjectKind object_kind() const noexcept;
   
 private:
 
@@ -108,6 +154,12 @@ private:
   // and cache coherence, at the cost of wasted memory.
   std::vector<Expression> m_tail;
 
+  // shared source of list elements used instead of m_tail, or nullptr
+  std::shared_ptr<const Sequence> m_seq;
+
+  // copy all sequence elements into the tail and drop the sequence
+  void materialize();
+
   // convenience typedef
   typedef std::vector<Expression>::iterator IteratorType;
   
@@ -118,11 +170,17 @@ private:
   Expression handle_lambda(Environment & env);
   Expression handle_set_property(Environment & env);
   Expression handle_get_property(Environment & env);
+  Expression handle_pipeline(Environment & env);
   Expression handle_discrete_plot(Environment & env);
   Expression handle_continuous_plot(Environment & env);
+  Expression handle_density_plot(Environment & env);
+  Expression handle_field_plot(Environment & env, bool contour);
 
   // the property map
   std::map<std::string, Expression> propmap;
+
+  // the primitive named by the "object-name" property, cached for dispatch
+  ObjectKind m_kind = NONE;
 };
 
 /// Render expression to output stream
@@ -130,5 +188,25 @@ std::ostream & operator<<(std::ostream & out, const Expression & exp);
 
 /// inequality comparison for two expressions (recursive)
 bool operator!=(const Expression & left, const Expression & right) noexcept;
+
+/*! Evaluate a single parameter lambda at each x, the entry point for sampling.
+  \param lambda the lambda expression, as stored in the environment
+  \param xs the arguments to evaluate at
+  \param env the environment the lambda is called from
+  \return the numeric result for each x, in the same order
+  \throws SemanticError when the lambda does not take one parameter or its body fails
+*/
+std::vector<double> evaluate_lambda(const Expression & lambda, const std::vector<double> & xs, const Environment & env);
+
+/*! Evaluate a two parameter lambda at each (x, y) pair.
+  \param lambda the lambda expression, as stored in the environment
+  \param xs the first arguments
+  \param ys the second arguments, the same length as xs
+  \param env the environment the lambda is called from
+  \return the numeric result for each pair, in the same order
+  \throws SemanticError when the lambda does not take two parameters or its body fails
+*/
+std::vector<double> evaluate_lambda(const Expression & lambda, const std::vector<double> & xs,
+  const std::vector<double> & ys, const Environment & env);
   
 #endif
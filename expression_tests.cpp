@@ -35,3 +35,58 @@ TEST_CASE( "Test complex expression", "[expression]" ) {
   REQUIRE(exp.isHeadComplex());
   REQUIRE(!exp.isHeadSymbol());
 }
+
+TEST_CASE( "Test expression hash", "[expression]" ) {
+
+  Expression list(Atom("list"));
+  list.append(Atom(1.));
+  list.append(Atom("\"a\""));
+
+  Expression same(Atom("list"));
+  same.append(Atom(1.));
+  same.append(Atom("\"a\""));
+  REQUIRE(list.hash() == same.hash());
+
+  INFO("the tail and properties are part of the hash")
+  Expression longer = same;
+  longer.append(Atom(2.));
+  REQUIRE(list.hash() != longer.hash());
+
+  same.set_property(Atom("\"size\""), Expression(Atom(2.)));
+  REQUIRE(list.hash() != same.hash());
+
+  REQUIRE(Expression(Atom(1.)).hash() != Expression(Atom(2.)).hash());
+  REQUIRE(Expression(Atom(1.)).hash() != Expression(Atom("\"1\"")).hash());
+}
+
+TEST_CASE( "Test expression object kind and property accessors", "[expression]" ) {
+
+  Expression point(Atom("list"));
+  point.append(Atom(3.));
+  point.append(Atom(4.));
+  REQUIRE(point.object_kind() == Expression::NONE);
+  REQUIRE(point.numberAt(0) == 3);
+  REQUIRE(point.numberAt(1) == 4);
+
+  INFO("the kind follows the object-name property, and is copied with it")
+  point.set_property(Atom("\"object-name\""), Expression(Atom("\"point\"")));
+  REQUIRE(point.object_kind() == Expression::POINT);
+  Expression copy = point;
+  REQUIRE(copy.object_kind() == Expression::POINT);
+  copy.set_property(Atom("\"object-name\""), Expression(Atom("\"polyline\"")));
+  REQUIRE(copy.object_kind() == Expression::POLYLINE);
+  copy.set_property(Atom("\"object-name\""), Expression(Atom("\"circle\"")));
+  REQUIRE(copy.object_kind() == Expression::OTHER);
+  copy = point;
+  REQUIRE(copy.object_kind() == Expression::POINT);
+
+  INFO("properties are found without copying them")
+  point.set_property(Atom("\"size\""), Expression(Atom(2.)));
+  point.set_property(Atom("\"label\""), Expression(Atom("\"a\"")));
+  REQUIRE(point.find_property("\"size\"") != nullptr);
+  REQUIRE(*point.find_property("\"label\"") == Expression(Atom("\"a\"")));
+  REQUIRE(point.find_property("\"width\"") == nullptr);
+  REQUIRE(point.number_property("\"size\"", 1) == 2);
+  REQUIRE(point.number_property("\"label\"", 1) == 1);
+  REQUIRE(point.number_property("\"width\"", 5) == 5);
+}
@@ -0,0 +1,16 @@
+/*! \file hash.hpp
+Defines helpers for structural hashes of expressions and plot primitives.
+ */
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <functional>
+
+/// mix the hash of value into seed, in the manner of boost::hash_combine
+template<typename T>
+void hash_combine(std::size_t & seed, const T & value){
+  seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+#endif
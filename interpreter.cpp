@@ -8,9 +8,14 @@
 #include "parse.hpp"
 #include "expression.hpp"
 #include "environment.hpp"
+#include "sampler.hpp"
 #include "startup_config.hpp"
 
-Interpreter::Interpreter(){
+Interpreter::Interpreter():
+  m_interrupt(std::make_shared<Interrupt>()), m_samplers(std::make_shared<SamplerRegistry>()){
+
+  env.set_interrupt(m_interrupt);
+  env.set_sampler_registry(m_samplers);
 
   std::ifstream ifs(STARTUP_FILE);
 
@@ -18,7 +23,12 @@ Interpreter::Interpreter(){
   evaluate();
 }
 
-Interpreter::Interpreter(ThreadSafeQueue<std::string> *programQueuePtr, ThreadSafeQueue<Expression> *expressionQueuePtr){
+Interpreter::Interpreter(ThreadSafeQueue<std::string> *programQueuePtr, ThreadSafeQueue<Expression> *expressionQueuePtr,
+                         std::function<void()> notify):
+  m_interrupt(std::make_shared<Interrupt>()), m_samplers(std::make_shared<SamplerRegistry>()){
+
+  env.set_interrupt(m_interrupt);
+  env.set_sampler_registry(m_samplers);
 
   std::ifstream ifs(STARTUP_FILE);
 
@@ -27,6 +37,7 @@ Interpreter::Interpreter(ThreadSafeQueue<std::string> *programQueuePtr, ThreadSa
 
   pq = programQueuePtr;
   expq = expressionQueuePtr;
+  this->notify = notify;
 }
 
 bool Interpreter::parseStream(std::istream & expression) noexcept{
@@ -41,5 +52,51 @@ bool Interpreter::parseStream(std::istream & expression) noexcept{
 
 Expression Interpreter::evaluate(){
 
-  return ast.eval(env);
+  // only a plot giving the result is drawn while it is built, not those
+  // built on the way to it, as an argument or a definition
+  const Expression * result = &ast;
+  while(result->head().isSymbol() && result->head().asSymbol() == "begin" && result->tailSize() > 0){
+    result = &*(result->tailConstEnd() - 1);
+  }
+  env.set_streamed(result);
+
+  m_interrupt->start();
+  try{
+    Expression value = ast.eval(env);
+    m_interrupt->finish();
+    env.set_streamed(nullptr);
+    return value;
+  }
+  catch(...){
+    m_interrupt->finish();
+    env.set_streamed(nullptr);
+    throw;
+  }
+}
+
+std::shared_ptr<Interrupt> Interpreter::interrupt() const{
+  return m_interrupt;
+}
+
+void Interpreter::set_plot_sink(std::shared_ptr<PlotSink> sink){
+  env.set_plot_sink(sink);
+}
+
+bool Interpreter::resample(const std::string & directive){
+
+  std::shared_ptr<PlotData> curves;
+  bool valid = true;
+
+  // sampled like an evaluation, so an interrupt or budget also stops it
+  m_interrupt->start();
+  try{
+    valid = ::resample(*m_samplers, directive, env, curves);
+  }
+  catch(const SemanticError &){
+    curves = nullptr;
+  }
+  m_interrupt->finish();
+
+  if (curves && env.plot_sink()) env.plot_sink()->resampled(curves);
+  return valid;
 }
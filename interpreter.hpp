@@ -8,13 +8,16 @@ It maintains an environment during evaluation.
 #define INTERPRETER_HPP
 
 // system includes
+#include <functional>
 #include <istream>
+#include <memory>
 #include <string>
 #include <iostream>
 
 // module includes
 #include "environment.hpp"
 #include "expression.hpp"
+#include "interrupt.hpp"
 #include "threadsafequeue.hpp"
 #include "semantic_error.hpp"
 
@@ -30,7 +33,13 @@ public:
 
   Interpreter();
 
-  Interpreter(ThreadSafeQueue<std::string> *programQueuePtr, ThreadSafeQueue<Expression> *expressionQueuePtr);
+  /*! Construct an interpreter run as a kernel on its own thread
+    \param programQueuePtr the queue programs are read from
+    \param expressionQueuePtr the queue results are pushed to
+    \param notify called on the kernel thread after each result is pushed, may be empty
+   */
+  Interpreter(ThreadSafeQueue<std::string> *programQueuePtr, ThreadSafeQueue<Expression> *expressionQueuePtr,
+              std::function<void()> notify = std::function<void()>());
 
   /*! Parse into an internal Expression from a stream
     \param expression the raw text stream repreenting the candidate expression
@@ -44,32 +53,61 @@ public:
    */
   Expression evaluate();
 
+  /*! The Interrupt checked by evaluate, shared by copies of this interpreter
+    so a front end can stop the copy running as a kernel.
+   */
+  std::shared_ptr<Interrupt> interrupt() const;
+
+  /*! Publish plots in chunks to sink while the plot procedures build them
+    \param sink the sink, shared by copies of this interpreter, or nullptr for none
+   */
+  void set_plot_sink(std::shared_ptr<PlotSink> sink);
+
+  /*! Apply a "%resample id x0 x1 pixels" directive, sending the curves of a
+    recent continuous-plot sampled over [x0, x1] to the plot sink. Curves whose
+    lambda fails over the range are not sent.
+    \param directive the directive sent by the front end
+    \return false if directive is not a valid resample directive
+   */
+  bool resample(const std::string & directive);
+
   void error(const std::string & err_str);
 
   void operator()()
   {
+    auto reply = [this](const Expression & exp){
+      expq->push(exp);
+      if (notify) notify();
+    };
+
     while(1){
       std::string program;
       pq->wait_and_pop(program);
 
       if (program == "%stop") return;
 
+      // re-sampling requests from the front end give no result
+      if (program.compare(0, 9, "%resample") == 0){
+        resample(program);
+        continue;
+      }
+
       std::istringstream expression(program);
 
       if(!parseStream(expression)){
         Expression exp = Expression(Atom("Error"));
         exp.append(Expression(Atom("Error: Invalid Expression. Could not parse.")));
-        expq->push(exp);
+        reply(exp);
       }
       else{
         try{
 				  Expression exp = evaluate();
-				  expq->push(exp);
+				  reply(exp);
         }
         catch(const SemanticError & ex){
           Expression exp = Expression(Atom("Error"));
           exp.append(Expression(Atom(ex.what())));
-          expq->push(exp);
+          reply(exp);
         }
       }
     }
@@ -80,11 +118,18 @@ private:
   // the environment
   Environment env;
 
+  // cancellation and budgets of evaluate
+  std::shared_ptr<Interrupt> m_interrupt;
+
+  // curves of recent continuous plots, for resample
+  std::shared_ptr<SamplerRegistry> m_samplers;
+
   // the AST
   Expression ast;
 
   ThreadSafeQueue<std::string> * pq;
   ThreadSafeQueue<Expression> * expq;
+  std::function<void()> notify;
   int * running;
 };
 
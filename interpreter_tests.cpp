@@ -4,11 +4,14 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <cmath>
+#include <set>
 
 #include "semantic_error.hpp"
 #include "interpreter.hpp"
 #include "threadsafequeue.hpp"
 #include "expression.hpp"
+#include "plot.hpp"
 
 Expression run(const std::string & program){
   
@@ -428,6 +431,8 @@ TEST_CASE( "Test some semantically invalid expresions", "[interpreter]" ) {
              "(range 0 1 -1)",
              "(range 1 1 1)",
              "(range 1 1 I)",
+             "(range 0 1e300 1)",
+             "(range 0 (/ 1 0) 1)",
              "(list 1 2 (lambda (x) (* 2 x)))",
              "(define 3 4)",
              "(lambda (3) (* 3 3))",
@@ -730,3 +735,601 @@ TEST_CASE("Test continuous-plot procdedure", "[interpreter]") {
   REQUIRE(result.tailSize() == 63);
 
 }
+
+TEST_CASE("Test sort and sort-by procedures", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying sort ascending")
+  program = "(sort (list 3 -1 2 0))";
+  result = run(program);
+  REQUIRE(result == run("(list -1 0 2 3)"));
+
+  INFO("trying sort descending")
+  program = "(sort (list 3 -1 2 0) \"descending\")";
+  result = run(program);
+  REQUIRE(result == run("(list 3 2 0 -1)"));
+
+  INFO("trying sort with a large list")
+  program = "(first (sort (range -50000 50000 1) \"descending\"))";
+  result = run(program);
+  REQUIRE(result == Expression(50000.));
+
+  INFO("trying sort-by with a lambda key, equal keys keep their order")
+  program = "(begin (define key (lambda (p) (first p))) "
+            "(sort-by key (list (list 2 0) (list 1 1) (list 2 2) (list 1 3))))";
+  result = run(program);
+  REQUIRE(result == run("(list (list 1 1) (list 1 3) (list 2 0) (list 2 2))"));
+
+  INFO("trying sort-by with a built-in key")
+  program = "(sort-by - (list 1 3 2))";
+  result = run(program);
+  REQUIRE(result == run("(list 3 2 1)"));
+
+  std::vector<std::string> programs = {"(sort (list 1 I))",
+                                       "(sort 1)",
+                                       "(sort (list 1) \"sideways\")",
+                                       "(sort-by (list 1 2))",
+                                       "(sort-by cos (list \"a\"))",
+                                       "(sort (list 1 (/ 0 0) 2))",
+                                       "(sort (list 1 (/ 0 0)) \"descending\")",
+                                       "(sort-by (lambda (x) (/ x 0)) (list 1 0 2))"};
+  for(auto s : programs){
+    Interpreter interp;
+
+    std::istringstream iss(s);
+
+    bool ok = interp.parseStream(iss);
+    REQUIRE(ok == true);
+
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE("Test lazy range", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying range printed as a list")
+  program = "(range 0 1 0.5)";
+  result = run(program);
+  REQUIRE(result == run("(list 0 0.5 1)"));
+
+  std::ostringstream out;
+  out << result;
+  REQUIRE(out.str() == "((0) (0.5) (1))");
+
+  INFO("trying length of a large range")
+  program = "(length (range 0 1 1e-7))";
+  result = run(program);
+  REQUIRE(result == Expression(10000001.));
+
+  INFO("trying first and rest of a stored range")
+  program = "(begin (define r (range 0 1 1e-7)) (first (rest (rest r))))";
+  result = run(program);
+  REQUIRE(result == Expression(2e-7));
+
+  INFO("trying map over a range")
+  program = "(map - (range 1 3 1))";
+  result = run(program);
+  REQUIRE(result == run("(list -1 -2 -3)"));
+
+  INFO("trying range in list procedures")
+  program = "(join (range 1 2 1) (append (range 3 4 1) 5))";
+  result = run(program);
+  REQUIRE(result == run("(list 1 2 3 4 5)"));
+}
+
+TEST_CASE("Test filter and fused map/filter pipelines", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying filter with a built-in predicate")
+  program = "(filter - (list 0 1 0 2))";
+  result = run(program);
+  REQUIRE(result == run("(list 1 2)"));
+
+  INFO("trying nested maps")
+  program = "(begin (define inc (lambda (x) (+ x 1))) (map inc (map - (list 1 2 3))))";
+  result = run(program);
+  REQUIRE(result == run("(list 0 -1 -2)"));
+
+  INFO("trying map over filter over a range")
+  program = "(begin (define skip-two (lambda (x) (- x 2))) (map - (filter skip-two (range 1 4 1))))";
+  result = run(program);
+  REQUIRE(result == run("(list -1 -3 -4)"));
+
+  INFO("trying a long fused pipeline")
+  program = "(length (map sin (map cos (range 0 1 1e-5))))";
+  result = run(program);
+  REQUIRE(result == Expression(100001.));
+
+  std::vector<std::string> programs = {"(filter - 1)",
+                                       "(filter (list 1) (list 1))",
+                                       "(filter list (list 1))",
+                                       "(map - (map (list 1) (list 1)))",
+                                       "(map - (filter - 1))",
+                                       "(define filter 1)"};
+  for(auto s : programs){
+    Interpreter interp;
+
+    std::istringstream iss(s);
+
+    bool ok = interp.parseStream(iss);
+    REQUIRE(ok == true);
+
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE("Test indexed list access and slice views", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying nth")
+  program = "(nth (list 5 6 7) 1)";
+  result = run(program);
+  REQUIRE(result == Expression(6.));
+
+  INFO("trying last")
+  program = "(last (list 5 6 7))";
+  result = run(program);
+  REQUIRE(result == Expression(7.));
+
+  INFO("trying slice")
+  program = "(slice (list 5 6 7 8) 1 3)";
+  result = run(program);
+  REQUIRE(result == run("(list 6 7)"));
+
+  INFO("trying an empty slice")
+  program = "(length (slice (list 5 6 7 8) 4 4))";
+  result = run(program);
+  REQUIRE(result == Expression(0.));
+
+  INFO("trying nth of a slice of a rest")
+  program = "(begin (define l (range 0 100 1)) (nth (slice (rest l) 10 20) 3))";
+  result = run(program);
+  REQUIRE(result == Expression(14.));
+
+  INFO("trying rest leaves the original list intact")
+  program = "(begin (define l (list 1 2 3)) (define r (rest l)) (join l r))";
+  result = run(program);
+  REQUIRE(result == run("(list 1 2 3 2 3)"));
+
+  std::vector<std::string> programs = {"(nth (list 1 2) 2)",
+                                       "(nth (list 1 2) 0.5)",
+                                       "(nth (list 1 2) -1)",
+                                       "(nth 1 0)",
+                                       "(last (list))",
+                                       "(slice (list 1 2) 2 1)",
+                                       "(slice (list 1 2) 0 3)",
+                                       "(slice (list 1 2) 0)"};
+  for(auto s : programs){
+    Interpreter interp;
+
+    std::istringstream iss(s);
+
+    bool ok = interp.parseStream(iss);
+    REQUIRE(ok == true);
+
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE("Test append and join keep earlier lists", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying two appends to the same list")
+  program = "(begin (define a (append (list 1) 2)) (define b (append a 3)) (define c (append a 4)) "
+            "(join (join a b) c))";
+  result = run(program);
+  REQUIRE(result == run("(list 1 2 1 2 3 1 2 4)"));
+
+  INFO("trying rest of an appended list")
+  program = "(rest (append (append (range 1 2 1) 3) 4))";
+  result = run(program);
+  REQUIRE(result == run("(list 2 3 4)"));
+}
+
+TEST_CASE("Test continuous-plot adaptive sampling", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying a straight line, no refinement needed")
+  program = "(begin (define f (lambda (x) (+ (* 2 x) 1))) "
+            "(continuous-plot f (list -2 2) (list (list \"sampling\" \"adaptive\"))))";
+  result = run(program);
+  // 9 segments between 10 samples + 6 axis lines + 4 bound labels
+  REQUIRE(result.tailSize() == 19);
+
+  INFO("trying a steep function, refined up to the sample limit")
+  program = "(begin (define g (lambda (x) (^ x 20))) "
+            "(continuous-plot g (list -1 1) (list (list \"sampling\" \"adaptive\") "
+            "(list \"min-samples\" 5) (list \"max-samples\" 40))))";
+  result = run(program);
+  REQUIRE(result.tailSize() > 4 + 5 + 4);
+  REQUIRE(result.tailSize() <= 39 + 5 + 4);
+
+  INFO("trying invalid sampling options")
+  std::vector<std::string> options = {"(list \"min-samples\" 1)",
+                                      "(list \"min-samples\" \"ten\")",
+                                      "(list \"min-samples\" 2.5)",
+                                      "(list \"min-samples\" -3)",
+                                      "(list \"max-samples\" \"ten\")",
+                                      "(list \"max-samples\" 20.5)",
+                                      "(list \"max-samples\" 0)",
+                                      "(list \"angle-tolerance\" \"small\")"};
+  for(auto option : options){
+    Interpreter interp;
+    std::istringstream iss("(begin (define f (lambda (x) x)) "
+                           "(continuous-plot f (list 0 1) (list (list \"sampling\" \"adaptive\") " + option + ")))");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE("Test batch lambda evaluation", "[interpreter]") {
+  Environment env;
+  Interpreter interp;
+
+  std::istringstream iss("(lambda (x) (begin (define y (* x x)) (+ y 1)))");
+  REQUIRE(interp.parseStream(iss));
+  Expression lambda = interp.evaluate();
+
+  INFO("trying a body with define, each sample in its own environment")
+  std::vector<double> ys = evaluate_lambda(lambda, {0, 1, 2, 3}, env);
+  REQUIRE(ys == std::vector<double>({1, 2, 5, 10}));
+
+  INFO("trying a lambda with two parameters")
+  std::istringstream iss2("(lambda (x y) (+ x y))");
+  REQUIRE(interp.parseStream(iss2));
+  REQUIRE_THROWS_AS(evaluate_lambda(interp.evaluate(), {0}, env), SemanticError);
+}
+
+TEST_CASE("Test parallel batch lambda evaluation", "[interpreter]") {
+  Environment env;
+  Interpreter interp;
+
+  std::istringstream iss("(lambda (x) (+ (* x (sin x)) (/ 1 (+ 2 (cos x)))))");
+  REQUIRE(interp.parseStream(iss));
+  Expression lambda = interp.evaluate();
+
+  std::vector<double> xs;
+  for (int i = 0; i < 20000; ++i) xs.push_back(-50 + i * 0.005);
+
+  INFO("trying a large batch, identical to evaluating one sample at a time")
+  std::vector<double> ys = evaluate_lambda(lambda, xs, env);
+  REQUIRE(ys.size() == xs.size());
+  for (std::size_t i = 0; i < xs.size(); i += 997) {
+    REQUIRE(ys[i] == evaluate_lambda(lambda, {xs[i]}, env)[0]);
+  }
+
+  INFO("trying a large batch that fails part way through")
+  std::istringstream iss2("(lambda (x) (first x))");
+  REQUIRE(interp.parseStream(iss2));
+  REQUIRE_THROWS_AS(evaluate_lambda(interp.evaluate(), xs, env), SemanticError);
+}
+
+TEST_CASE("Test discrete-plot decimation", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying a large data set, decimated to the default resolution")
+  program = "(begin (define f (lambda (x) (list x (sin x)))) "
+            "(discrete-plot (map f (range 0 4999 1)) (list)))";
+  result = run(program);
+  // 5 frame lines + at most 2 points and 2 stems per column + 4 bound labels
+  REQUIRE(result.tailSize() <= 5 + 4 * 1000 + 4);
+  REQUIRE(result.tailSize() > 5 + 4);
+
+  INFO("trying a resolution of 0, every point is drawn")
+  program = "(begin (define f (lambda (x) (list x (sin x)))) "
+            "(discrete-plot (map f (range 0 4999 1)) (list (list \"resolution\" 0))))";
+  result = run(program);
+  REQUIRE(result.tailSize() == 5 + 2 * 5000 + 4);
+
+  INFO("trying an explicit resolution")
+  program = "(begin (define f (lambda (x) (list x (sin x)))) "
+            "(discrete-plot (map f (range 0 4999 1)) (list (list \"resolution\" 100))))";
+  result = run(program);
+  REQUIRE(result.tailSize() <= 5 + 4 * 100 + 4);
+
+  INFO("trying an invalid resolution")
+  Interpreter interp;
+  std::istringstream iss("(discrete-plot (list (list 0 0) (list 1 1)) (list (list \"resolution\" -1)))");
+  REQUIRE(interp.parseStream(iss));
+  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+}
+
+TEST_CASE("Test density-plot", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying a density-plot, one image whatever the number of points")
+  program = "(begin (define f (lambda (x) (list (sin x) (cos (* 3 x))))) "
+            "(density-plot (map f (range 0 2000 0.5)) (list (list \"bins\" 8) (list \"title\" \"Density\"))))";
+  result = run(program);
+  // image + 6 frame lines + title + 4 bound labels
+  REQUIRE(result.tailSize() == 12);
+
+  Expression image = result.tailAt(0);
+  REQUIRE(image.get_property(Atom("\"object-name\"")) == Expression(Atom("\"image\"")));
+  REQUIRE(image.tailSize() == 8);
+  REQUIRE(image.tailAt(0).tailSize() == 8);
+
+  double total = 0;
+  for (int r = 0; r < 8; ++r) {
+    for (int c = 0; c < 8; ++c) {
+      total += image.tailAt(r).tailAt(c).head().asNumber();
+    }
+  }
+  REQUIRE(total == 4001);
+
+  INFO("trying invalid bins, too few or too many to allocate")
+  for (std::string bins : {"0", "1e9"}) {
+    Interpreter interp;
+    std::istringstream iss("(density-plot (list (list 0 0) (list 1 1)) (list (list \"bins\" " + bins + ")))");
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE("Test heatmap-plot and contour-plot", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying a heatmap-plot, one image sampled at the cell centers")
+  program = "(begin (define f (lambda (x y) (+ x y))) "
+            "(heatmap-plot f (list 0 1) (list 0 1) (list (list \"grid\" 2))))";
+  result = run(program);
+  // image + 4 frame lines + 4 bound labels
+  REQUIRE(result.tailSize() == 9);
+
+  Expression image = result.tailAt(0);
+  REQUIRE(image.get_property(Atom("\"object-name\"")) == Expression(Atom("\"image\"")));
+  REQUIRE(image.get_property(Atom("\"shading\"")) == Expression(Atom("\"linear\"")));
+  REQUIRE(image.tailAt(0).tailAt(0) == Expression(1.));
+  REQUIRE(image.tailAt(0).tailAt(1) == Expression(1.5));
+  REQUIRE(image.tailAt(1).tailAt(0) == Expression(0.5));
+
+  INFO("trying a contour-plot, one closed line per level of a bowl")
+  program = "(begin (define f (lambda (x y) (+ (* x x) (* y y)))) "
+            "(contour-plot f (list -1 1) (list -1 1) (list (list \"grid\" 5) (list \"levels\" 1))))";
+  result = run(program);
+  // polyline + 6 frame lines + 4 bound labels
+  REQUIRE(result.tailSize() == 11);
+
+  Expression line = result.tailAt(0);
+  REQUIRE(line.get_property(Atom("\"object-name\"")) == Expression(Atom("\"polyline\"")));
+  REQUIRE(line.tailSize() == 13);
+  REQUIRE(line.tailAt(0) == line.tailAt(12));
+
+  INFO("trying invalid arguments")
+  std::vector<std::string> invalid = {
+    "(heatmap-plot (lambda (x) x) (list 0 1) (list 0 1))",
+    "(heatmap-plot (lambda (x y) x) (list 1 0) (list 0 1))",
+    "(contour-plot (lambda (x y) x) (list 0 1) (list 0 1) (list (list \"levels\" 0)))",
+    "(contour-plot (lambda (x y) x) (list 0 1) (list 0 1) (list (list \"grid\" 1)))",
+    "(contour-plot (lambda (x y) x) (list 0 1) (list 0 1) (list (list \"levels\" 1e12)))",
+    "(heatmap-plot (lambda (x y) x) (list 0 1) (list 0 1) (list (list \"grid\" 1e6)))",
+    "(contour-plot (lambda (x y) x) (list 0 1))"};
+  for (auto & bad : invalid) {
+    Interpreter interp;
+    std::istringstream iss(bad);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  }
+}
+
+TEST_CASE("Test multi-series plots", "[interpreter]") {
+  Expression result;
+
+  std::string program;
+
+  INFO("trying discrete-plot with two series on shared axes")
+  program = "(discrete-plot (list (list (list -1 -1) (list 1 1)) (list (list 0 2) (list 2 0) (list 3 1))) (list))";
+  result = run(program);
+  // 6 frame lines + 5 points and 5 stems + 4 bound labels
+  REQUIRE(result.tailSize() == 20);
+
+  INFO("bounds cover every series")
+  REQUIRE(result.tailAt(result.tailSize() - 2).head() == Atom("3"));
+  REQUIRE(result.tailAt(result.tailSize() - 1).head() == Atom("-1"));
+
+  INFO("trying continuous-plot with a list of lambdas")
+  program = "(begin (define f (lambda (x) x)) (define g (lambda (x) (* x x))) "
+            "(continuous-plot (list f g) (list -1 1)))";
+  result = run(program);
+  // 2 x 50 segments + 6 frame lines + 4 bound labels
+  REQUIRE(result.tailSize() == 110);
+
+  INFO("trying continuous-plot with a list holding a non-lambda")
+  Interpreter interp;
+  std::istringstream iss("(begin (define f (lambda (x) x)) (continuous-plot (list f 1) (list -1 1)))");
+  REQUIRE(interp.parseStream(iss));
+  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+}
+
+// counts the primitives of plots published while they are built
+class CountSink: public PlotSink {
+public:
+
+  void receive(std::size_t, std::shared_ptr<const PlotData> chunk, bool last){
+    primitives += chunk->order.size();
+    chunks += 1;
+    if (last) plots += 1;
+  }
+
+  std::size_t primitives = 0;
+  std::size_t chunks = 0;
+  std::size_t plots = 0;
+};
+
+TEST_CASE("Test plot streaming", "[interpreter]") {
+
+  Interpreter interp;
+  auto sink = std::make_shared<CountSink>();
+  interp.set_plot_sink(sink);
+
+  INFO("a large plot is published in several chunks covering all of it")
+  std::istringstream iss("(begin (define f (lambda (x) (list x (sin x)))) "
+                         "(discrete-plot (map f (range 0 9999 1)) (list (list \"resolution\" 0))))");
+  REQUIRE(interp.parseStream(iss));
+  Expression result = interp.evaluate();
+
+  REQUIRE(sink->plots == 1);
+  REQUIRE(sink->chunks > 1);
+  REQUIRE(sink->primitives == static_cast<std::size_t>(result.tailSize()));
+
+  INFO("plots that are not the result are not published")
+  std::vector<std::string> programs = {"(length (discrete-plot (list (list 1 1) (list 2 2)) (list)))",
+                                       "(begin (define p (discrete-plot (list (list 1 1) (list 2 2)) (list))) 1)",
+                                       "(list (discrete-plot (list (list 1 1) (list 2 2)) (list)))",
+                                       "(begin (discrete-plot (list (list 1 1) (list 2 2)) (list)) 1)"};
+  for(auto program : programs){
+    std::istringstream other(program);
+    REQUIRE(interp.parseStream(other));
+    interp.evaluate();
+    REQUIRE(sink->plots == 1);
+  }
+
+  INFO("the plot ending a begin is the result")
+  std::istringstream last("(begin (define a 1) (begin (discrete-plot (list (list 1 1) (list 2 2)) (list))))");
+  REQUIRE(interp.parseStream(last));
+  interp.evaluate();
+  REQUIRE(sink->plots == 2);
+}
+
+// keeps the curves sent back by resample directives
+class ResampleSink: public PlotSink {
+public:
+
+  void receive(std::size_t, std::shared_ptr<const PlotData>, bool){}
+
+  void resampled(std::shared_ptr<const PlotData> curves){
+    received.push_back(curves);
+  }
+
+  std::vector<std::shared_ptr<const PlotData>> received;
+};
+
+TEST_CASE("Test continuous plot resampling", "[interpreter]") {
+
+  Interpreter interp;
+  auto sink = std::make_shared<ResampleSink>();
+  interp.set_plot_sink(sink);
+
+  std::istringstream iss("(begin (define f (lambda (x) (sin x))) (continuous-plot f (list 0 10)))");
+  REQUIRE(interp.parseStream(iss));
+  Expression result = interp.evaluate();
+
+  auto plot = std::dynamic_pointer_cast<const PlotSequence>(result.sequence());
+  REQUIRE(plot != nullptr);
+  std::size_t id = plot->data().sampler;
+  REQUIRE(id != 0);
+
+  INFO("a zoomed in range comes back sampled at screen resolution, in the plot's view")
+  std::ostringstream directive;
+  directive << "%resample " << id << " 2 3 400";
+  REQUIRE(interp.resample(directive.str()));
+  REQUIRE(sink->received.size() == 1);
+
+  auto curves = sink->received.front();
+  REQUIRE(curves->sampler == id);
+  REQUIRE(curves->view.sx == plot->data().view.sx);
+  REQUIRE(curves->view.sy == plot->data().view.sy);
+  REQUIRE(curves->series.size() == 1);
+  REQUIRE(curves->segments.size() >= 400);
+  for(auto & segment : curves->segments){
+    REQUIRE(curves->y[segment.from] == Approx(std::sin(curves->x[segment.from])));
+  }
+
+  INFO("other plots and bad directives send nothing")
+  REQUIRE(interp.resample("%resample 0 2 3 400"));
+  REQUIRE(!interp.resample("%resample"));
+  REQUIRE(sink->received.size() == 1);
+}
+
+TEST_CASE("Test discrete plot resampling", "[interpreter]") {
+
+  Interpreter interp;
+  auto sink = std::make_shared<ResampleSink>();
+  interp.set_plot_sink(sink);
+
+  std::ostringstream program;
+  program << "(discrete-plot (list";
+  for(int i = 0; i < 1000; ++i){
+    program << " (list " << i << " " << (i % 7) << ")";
+  }
+  program << ") (list (list \"resolution\" 10)))";
+
+  std::istringstream iss(program.str());
+  REQUIRE(interp.parseStream(iss));
+  Expression result = interp.evaluate();
+
+  auto plot = std::dynamic_pointer_cast<const PlotSequence>(result.sequence());
+  REQUIRE(plot != nullptr);
+  const PlotData & data = plot->data();
+  std::size_t id = data.sampler;
+  REQUIRE(id != 0);
+
+  // a point the first decimation dropped
+  std::set<double> drawn;
+  for(auto & point : data.points){
+    drawn.insert(data.x[point.vertex]);
+  }
+  int dropped = 0;
+  while(drawn.count(dropped)) ++dropped;
+  REQUIRE(dropped < 1000);
+
+  INFO("a zoomed in range is decimated again from the raw data, bringing back dropped points")
+  std::ostringstream directive;
+  directive << "%resample " << id << " " << dropped - 5 << " " << dropped + 5 << " 400";
+  REQUIRE(interp.resample(directive.str()));
+  REQUIRE(sink->received.size() == 1);
+
+  auto points = sink->received.front();
+  REQUIRE(points->sampler == id);
+  REQUIRE(points->view.sx == data.view.sx);
+  REQUIRE(points->view.sy == data.view.sy);
+  REQUIRE(points->series.size() == 1);
+  REQUIRE(points->points.size() == points->segments.size());
+
+  bool found = false;
+  for(auto & point : points->points){
+    double x = points->x[point.vertex];
+    REQUIRE(x >= dropped - 5);
+    REQUIRE(x <= dropped + 5);
+    REQUIRE(points->y[point.vertex] == static_cast<int>(x) % 7);
+    if(x == dropped) found = true;
+  }
+  REQUIRE(found);
+
+  INFO("the stems rise from the same foot as in the plot")
+  double foot = 0;
+  for(auto & segment : data.segments){
+    if(segment.stem) foot = data.y[segment.from];
+  }
+  for(auto & segment : points->segments){
+    REQUIRE(segment.stem);
+    REQUIRE(points->y[segment.from] == foot);
+  }
+
+  INFO("plots drawing every point are not kept")
+  std::istringstream small("(discrete-plot (list (list 1 1) (list 2 2)) (list))");
+  REQUIRE(interp.parseStream(small));
+  result = interp.evaluate();
+  plot = std::dynamic_pointer_cast<const PlotSequence>(result.sequence());
+  REQUIRE(plot != nullptr);
+  REQUIRE(plot->data().sampler == 0);
+}
@@ -0,0 +1,116 @@
+#include "interrupt.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+#include "semantic_error.hpp"
+
+Interrupt::Interrupt():
+  m_evaluation(0), m_requested(0), m_cancelled(false), m_steps(0), m_step_budget(0), m_time_budget(0){}
+
+bool Interrupt::request() noexcept{
+  std::size_t evaluation = m_evaluation;
+  if(evaluation % 2 == 0) return false;
+
+  m_requested = evaluation;
+  return true;
+}
+
+void Interrupt::cancel() noexcept{
+  m_cancelled = true;
+}
+
+void Interrupt::resume() noexcept{
+  m_cancelled = false;
+}
+
+void Interrupt::set_step_budget(std::size_t steps) noexcept{
+  m_step_budget = steps;
+}
+
+void Interrupt::set_time_budget(double ms) noexcept{
+  m_time_budget = ms;
+}
+
+void Interrupt::start() noexcept{
+  m_steps = 0;
+  m_start = std::chrono::steady_clock::now();
+  m_evaluation += (m_evaluation % 2 == 0) ? 1 : 2;
+}
+
+void Interrupt::finish() noexcept{
+  if(m_evaluation % 2 == 1) ++m_evaluation;
+}
+
+void Interrupt::step(){
+  // counted per thread so the shared state is only touched once per check,
+  // starting again for each evaluation so no count carries over to the next
+  struct Count {
+    const Interrupt * owner;
+    std::size_t evaluation;
+    std::size_t steps;
+    std::size_t next;
+  };
+  thread_local Count count = {nullptr, 0, 0, 0};
+
+  std::size_t evaluation = m_evaluation.load(std::memory_order_relaxed);
+  if(count.owner != this || count.evaluation != evaluation){
+    count.owner = this;
+    count.evaluation = evaluation;
+    count.steps = 0;
+    count.next = interval(m_steps);
+  }
+
+  if(++count.steps < count.next) return;
+  count.next = check(count.steps);
+  count.steps = 0;
+}
+
+std::size_t Interrupt::interval(std::size_t steps) const noexcept{
+  // check again at the step after the last one the budget allows
+  std::size_t budget = m_step_budget;
+  if(budget == 0) return INTERRUPT_CHECK_STEPS;
+  if(steps > budget) return 1;
+  return std::min(budget - steps + 1, INTERRUPT_CHECK_STEPS);
+}
+
+std::size_t Interrupt::check(std::size_t steps){
+
+  if(m_cancelled || m_requested == m_evaluation){
+    throw SemanticError("Error during evaluation: interrupted");
+  }
+
+  std::size_t budget = m_step_budget;
+  std::size_t total = m_steps.fetch_add(steps) + steps;
+  if(budget != 0 && total > budget){
+    throw SemanticError("Error during evaluation: step budget exceeded");
+  }
+
+  double limit = m_time_budget;
+  if(limit > 0){
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_start;
+    if(elapsed.count() > limit){
+      throw SemanticError("Error during evaluation: time budget exceeded");
+    }
+  }
+
+  return interval(total);
+}
+
+bool set_budget(Interrupt & interrupt, const std::string & directive){
+  std::istringstream iss(directive);
+  std::string name;
+  double value;
+
+  if(!(iss >> name >> value) || value < 0 || !(iss >> std::ws).eof()) return false;
+
+  if(name == "%budget"){
+    interrupt.set_step_budget(static_cast<std::size_t>(value));
+  }
+  else if(name == "%timeout"){
+    interrupt.set_time_budget(value);
+  }
+  else return false;
+
+  return true;
+}
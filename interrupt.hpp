@@ -0,0 +1,88 @@
+/*! \file interrupt.hpp
+Defines the cooperative cancellation of a running evaluation.
+
+A kernel and the front end driving it share an Interrupt. The front end may
+request an interrupt or limit the steps and time of each evaluation, and the
+evaluator checks the Interrupt as it goes, stopping with a SemanticError so
+the kernel and its environment stay usable.
+ */
+#ifndef INTERRUPT_HPP
+#define INTERRUPT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/// number of evaluation steps on one thread between checks of the Interrupt
+const std::size_t INTERRUPT_CHECK_STEPS = 1024;
+
+/*! \class Interrupt
+\brief Cancellation token and budgets for one evaluation at a time.
+
+request and the budget setters may be called from any thread, and request
+also from a signal handler. step is called by the evaluator on every
+expression it evaluates, from every thread taking part in the evaluation.
+*/
+class Interrupt {
+public:
+
+  Interrupt();
+
+  /*! Ask the evaluation in progress to stop
+    \return true if an evaluation was in progress
+  */
+  bool request() noexcept;
+
+  /// stop the evaluation in progress and every one started until resume, for a kernel being stopped
+  void cancel() noexcept;
+
+  /// let evaluations run again after cancel
+  void resume() noexcept;
+
+  /// limit each evaluation to steps expression evaluations, 0 for no limit, exact on one
+  /// thread and overrun by at most INTERRUPT_CHECK_STEPS on each other thread taking part
+  void set_step_budget(std::size_t steps) noexcept;
+
+  /// limit each evaluation to ms milliseconds, 0 for no limit
+  void set_time_budget(double ms) noexcept;
+
+  /// mark the start of an evaluation, earlier requests were for earlier evaluations
+  void start() noexcept;
+
+  /// mark the end of an evaluation
+  void finish() noexcept;
+
+  /*! Count one evaluation step, checking the request and time budget every
+    INTERRUPT_CHECK_STEPS steps and the step budget when it may be reached
+    \throws SemanticError when interrupted or over budget
+  */
+  void step();
+
+private:
+
+  // add the steps counted on this thread since its last check, return the steps until the next check
+  std::size_t check(std::size_t steps);
+
+  // steps until the first check of an evaluation on a thread
+  std::size_t interval(std::size_t steps) const noexcept;
+
+  // bumped by start and by finish, so it is odd during an evaluation and
+  // numbers it; a request is tagged with the evaluation it is for
+  std::atomic<std::size_t> m_evaluation;
+  std::atomic<std::size_t> m_requested;
+  std::atomic<bool> m_cancelled;
+  std::atomic<std::size_t> m_steps;
+  std::atomic<std::size_t> m_step_budget;
+  std::atomic<double> m_time_budget;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+/*! Apply a budget kernel directive, "%budget steps" or "%timeout ms", 0 removing the limit
+  \param interrupt the kernel's Interrupt
+  \param directive the directive as typed
+  \return false if directive is not a valid budget directive
+*/
+bool set_budget(Interrupt & interrupt, const std::string & directive);
+
+#endif
@@ -0,0 +1,164 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "interpreter.hpp"
+#include "interrupt.hpp"
+#include "semantic_error.hpp"
+
+// a program taking many steps, long enough to be interrupted while it runs
+const std::string LONG_PROGRAM = "(begin (define f (lambda (x) (+ x 1))) (length (map f (range 0 3000000 1))))";
+
+TEST_CASE( "Test Interrupt request", "[interrupt]" ) {
+
+  Interrupt interrupt;
+
+  INFO("no request outside an evaluation")
+  REQUIRE(!interrupt.request());
+
+  interrupt.start();
+  for(std::size_t i = 0; i < 2 * INTERRUPT_CHECK_STEPS; ++i){
+    interrupt.step();
+  }
+
+  INFO("a request during an evaluation stops it at the next check")
+  REQUIRE(interrupt.request());
+  REQUIRE_THROWS_WITH([&](){
+    for(std::size_t i = 0; i < INTERRUPT_CHECK_STEPS; ++i) interrupt.step();
+  }(), "Error during evaluation: interrupted");
+  interrupt.finish();
+
+  INFO("starting the next evaluation drops the request")
+  interrupt.start();
+  for(std::size_t i = 0; i < 2 * INTERRUPT_CHECK_STEPS; ++i){
+    interrupt.step();
+  }
+  interrupt.finish();
+}
+
+TEST_CASE( "Test Interrupt cancel", "[interrupt]" ) {
+
+  Interrupt interrupt;
+
+  INFO("a cancel before an evaluation starts still stops it")
+  interrupt.cancel();
+  for(int run = 0; run < 2; ++run){
+    interrupt.start();
+    REQUIRE_THROWS_WITH([&](){
+      for(std::size_t i = 0; i < INTERRUPT_CHECK_STEPS; ++i) interrupt.step();
+    }(), "Error during evaluation: interrupted");
+    interrupt.finish();
+  }
+
+  INFO("evaluations run again once resumed")
+  interrupt.resume();
+  interrupt.start();
+  for(std::size_t i = 0; i < 2 * INTERRUPT_CHECK_STEPS; ++i){
+    interrupt.step();
+  }
+  interrupt.finish();
+}
+
+TEST_CASE( "Test Interrupt step counts", "[interrupt]" ) {
+
+  Interrupt interrupt;
+
+  INFO("a budget below the check interval is exact")
+  interrupt.set_step_budget(100);
+  for(int run = 0; run < 2; ++run){
+    interrupt.start();
+    for(std::size_t i = 0; i < 100; ++i){
+      interrupt.step();
+    }
+    REQUIRE_THROWS_WITH(interrupt.step(), "Error during evaluation: step budget exceeded");
+    interrupt.finish();
+  }
+
+  INFO("a budget above it is exact too")
+  interrupt.set_step_budget(INTERRUPT_CHECK_STEPS + 10);
+  interrupt.start();
+  for(std::size_t i = 0; i < INTERRUPT_CHECK_STEPS + 10; ++i){
+    interrupt.step();
+  }
+  REQUIRE_THROWS_WITH(interrupt.step(), "Error during evaluation: step budget exceeded");
+  interrupt.finish();
+  interrupt.set_step_budget(0);
+
+  INFO("steps of an earlier evaluation do not bring the next check forward")
+  interrupt.start();
+  for(std::size_t i = 0; i < INTERRUPT_CHECK_STEPS - 1; ++i){
+    interrupt.step();
+  }
+  interrupt.finish();
+  interrupt.start();
+  REQUIRE(interrupt.request());
+  for(std::size_t i = 0; i < INTERRUPT_CHECK_STEPS - 1; ++i){
+    interrupt.step();
+  }
+  REQUIRE_THROWS_WITH(interrupt.step(), "Error during evaluation: interrupted");
+  interrupt.finish();
+}
+
+TEST_CASE( "Test Interrupt budgets", "[interrupt]" ) {
+
+  Interpreter interp;
+  std::istringstream define("(define a 42)");
+  REQUIRE(interp.parseStream(define));
+  interp.evaluate();
+
+  INFO("a step budget stops a long evaluation")
+  interp.interrupt()->set_step_budget(10 * INTERRUPT_CHECK_STEPS);
+  std::istringstream iss(LONG_PROGRAM);
+  REQUIRE(interp.parseStream(iss));
+  REQUIRE_THROWS_WITH(interp.evaluate(), "Error during evaluation: step budget exceeded");
+
+  INFO("the environment survives the interrupted evaluation")
+  interp.interrupt()->set_step_budget(0);
+  std::istringstream lookup("(begin a)");
+  REQUIRE(interp.parseStream(lookup));
+  REQUIRE(interp.evaluate() == Expression(42.));
+
+  INFO("a time budget stops a long evaluation")
+  interp.interrupt()->set_time_budget(1);
+  std::istringstream timed(LONG_PROGRAM);
+  REQUIRE(interp.parseStream(timed));
+  REQUIRE_THROWS_WITH(interp.evaluate(), "Error during evaluation: time budget exceeded");
+}
+
+TEST_CASE( "Test interrupting a running evaluation", "[interrupt]" ) {
+
+  Interpreter interp;
+  auto interrupt = interp.interrupt();
+
+  // request until an evaluation is in progress to receive it
+  std::thread requester([interrupt](){
+    while(!interrupt->request()) std::this_thread::yield();
+  });
+
+  std::istringstream iss(LONG_PROGRAM);
+  REQUIRE(interp.parseStream(iss));
+  REQUIRE_THROWS_WITH(interp.evaluate(), "Error during evaluation: interrupted");
+  requester.join();
+
+  INFO("the next evaluation runs normally")
+  std::istringstream next("(+ 1 2)");
+  REQUIRE(interp.parseStream(next));
+  REQUIRE(interp.evaluate() == Expression(3.));
+}
+
+TEST_CASE( "Test budget directives", "[interrupt]" ) {
+
+  Interrupt interrupt;
+
+  REQUIRE(set_budget(interrupt, "%budget 5000"));
+  REQUIRE(set_budget(interrupt, "%timeout 250"));
+  REQUIRE(set_budget(interrupt, "%budget 0"));
+
+  REQUIRE(!set_budget(interrupt, "%budget"));
+  REQUIRE(!set_budget(interrupt, "%budget -1"));
+  REQUIRE(!set_budget(interrupt, "%budget 10 20"));
+  REQUIRE(!set_budget(interrupt, "%timeout ms"));
+  REQUIRE(!set_budget(interrupt, "%reset 10"));
+}
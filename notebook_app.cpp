@@ -5,6 +5,7 @@
 
 #include <QVBoxLayout>
 #include <QHBoxLayout>
+#include <QLabel>
 #include <QPushButton>
 
 NotebookApp::NotebookApp() {
@@ -34,6 +35,12 @@ NotebookApp::NotebookApp() {
   interrupt->setObjectName("interrupt");
   button_layout->addWidget(interrupt);
 
+  // shown while the kernel is evaluating
+  auto busy = new QLabel("Evaluating...", this);
+  busy->setObjectName("busy");
+  busy->setVisible(false);
+  button_layout->addWidget(busy);
+
   layout->addLayout(button_layout);
   layout->addWidget(input);
   layout->addWidget(output);
@@ -45,4 +52,5 @@ NotebookApp::NotebookApp() {
   QObject::connect(stop, SIGNAL(clicked()), output, SLOT(stop_kernel()));
   QObject::connect(reset, SIGNAL(clicked()), output, SLOT(reset_kernel()));
   QObject::connect(interrupt, SIGNAL(clicked()), output, SLOT(interrupt()));
+  QObject::connect(output, &OutputWidget::evaluating, busy, &QLabel::setVisible);
 }
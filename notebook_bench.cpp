@@ -0,0 +1,88 @@
+/*
+Benchmarks for drawing notebook results. Not part of the test suite, run the
+notebook_bench executable directly from a release build, with
+QT_QPA_PLATFORM=offscreen where there is no display.
+ */
+#include <QApplication>
+#include <QGraphicsScene>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "expression.hpp"
+#include "render.hpp"
+
+// time a single call of fn in milliseconds
+double time_ms(const std::function<void()> & fn){
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// a list of n primitives built as make-point and make-text build them,
+// alternately points and text labels at points
+Expression primitives(std::size_t n){
+  Expression list(Atom("list"));
+  for(std::size_t i = 0; i < n; ++i){
+    Expression point(Atom("list"));
+    point.append(Atom(double(i % 1000)));
+    point.append(Atom(double(i / 1000)));
+    point.set_property(Atom("\"object-name\""), Expression(Atom("\"point\"")));
+    point.set_property(Atom("\"size\""), Expression(Atom(0.5)));
+    if(i % 2 == 0){
+      list.append(point);
+      continue;
+    }
+
+    Expression text(Atom("\"label\""));
+    text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
+    text.set_property(Atom("\"position\""), point);
+    text.set_property(Atom("\"text-scale\""), Expression(Atom(1.)));
+    text.set_property(Atom("\"text-rotation\""), Expression(Atom(0.)));
+    list.append(text);
+  }
+  return list;
+}
+
+void bench_primitives(){
+  std::cout << "text and point objects" << std::endl;
+  std::cout << std::setw(12) << "n" << std::setw(16) << "render ms" << std::setw(16) << "show ms"
+            << std::setw(16) << "ns per object" << std::endl;
+
+  for(std::size_t n = 1000; n <= 100000; n *= 10){
+    RenderJob job;
+    job.kind = RenderJob::RESULT;
+    job.generation = 1;
+    job.result = primitives(n);
+
+    // decoding on the render thread, then creating the items on the GUI thread
+    Renderer renderer(nullptr, nullptr, std::function<void()>());
+    std::shared_ptr<Rendered> rendered;
+    double render = time_ms([&](){ rendered = renderer.render(job); });
+
+    QGraphicsScene scene;
+    double show = time_ms([&](){
+      for(auto & group : rendered->groups){
+        group.rendering->show(&scene);
+      }
+    });
+
+    std::cout << std::setw(12) << n << std::setw(16) << render << std::setw(16) << show
+              << std::setw(16) << 1e6 * (render + show) / n << std::endl;
+  }
+}
+
+int main(int argc, char * argv[]){
+
+  // text items are laid out with the fonts of a GUI application
+  QApplication app(argc, argv);
+
+  bench_primitives();
+
+  return EXIT_SUCCESS;
+}
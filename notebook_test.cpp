@@ -3,13 +3,23 @@
 #include "notebook_app.hpp"
 #include "input_widget.hpp"
 #include "output_widget.hpp"
+#include "plot_item.hpp"
+#include "render.hpp"
 
 #include <QGraphicsView>
 #include <QGraphicsItem>
 #include <QGraphicsScene>
+#include <QGraphicsPixmapItem>
 #include <QPainterPath>
 #include <QMarginsF>
 #include <QPushButton>
+#include <QLabel>
+#include <QImage>
+#include <QElapsedTimer>
+#include <QPainter>
+
+#include <sstream>
+#include <thread>
 
 class NotebookTest : public QObject {
   Q_OBJECT
@@ -36,6 +46,16 @@ private slots:
   void testContinuousPlot();
   void testStopStart();
   void testReset();
+  void testResetWhileRunning();
+  void testBusyIndicator();
+  void testInterrupt();
+  void testStreamedPlot();
+  void testPlotValueUnderMouse();
+  void testResampleOnZoom();
+  void testTiledPlotItem();
+  void testRetainedScene();
+  void testRetainedStacking();
+  void testRenderThread();
 
 private:
 
@@ -67,6 +87,7 @@ void NotebookTest::testNoneProperty() {
 
   QTest::keyClicks(in, "(get-property \"key\" (3))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -81,6 +102,7 @@ void NotebookTest::testCosine() {
 
   QTest::keyClicks(in, "(cos pi)");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -95,6 +117,7 @@ void NotebookTest::testExponential() {
 
   QTest::keyClicks(in, "(^ e (- (* I pi)))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -109,6 +132,7 @@ void NotebookTest::testDefineText() {
 
   QTest::keyClicks(in, "(begin (define title \"The Title\") (title))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -123,6 +147,7 @@ void NotebookTest::testLambdaNoOutput() {
 
   QTest::keyClicks(in, "(define inc (lambda (x) (+ x 1)))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
 
@@ -136,6 +161,7 @@ void NotebookTest::testMakeZeroPoint() {
 
   QTest::keyClicks(in, "(make-point 0 0)");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsEllipseItem *>(itemList.front());
@@ -150,6 +176,7 @@ void NotebookTest::testMakePoint() {
 
   QTest::keyClicks(in, "(set-property \"size\" 20 (make-point 0 0))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsEllipseItem *>(itemList.front());
@@ -165,6 +192,7 @@ void NotebookTest::testMultiplePoint() {
   QTest::keyClicks(in, "(list (set-property \"size\" 14 (make-point 7 9))\
                         (set-property \"size\" 5 (make-point 3 2)))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto firstPoint = dynamic_cast<QGraphicsEllipseItem *>(itemList[1]);
@@ -182,6 +210,7 @@ void NotebookTest::testMakeLine() {
   QTest::keyClicks(in, "(set-property \"thickness\" (4) (make-line\
                         (make-point 0 0) (make-point 20 20)))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsLineItem *>(itemList.front());
@@ -200,6 +229,7 @@ void NotebookTest::testMultipleLine() {
                               (make-line (make-point 20 0) (make-point 20 20)))");
 
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto firstLine = dynamic_cast<QGraphicsLineItem *>(itemList[2]);
@@ -223,6 +253,7 @@ void NotebookTest::testMakeText() {
 
   QTest::keyClicks(in, "(make-text \"Hello World!\")");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -243,6 +274,7 @@ void NotebookTest::testMultipleText() {
                         (set-property \"position\" (make-point (+ xloc 100) yloc) (make-text \"Hi5\"))))");
 
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto firstText = dynamic_cast<QGraphicsTextItem *>(itemList[4]);
@@ -269,6 +301,7 @@ void NotebookTest::testInvalidExpression() {
 
   QTest::keyClicks(in, "(begin))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -283,6 +316,7 @@ void NotebookTest::testSemanticError() {
 
   QTest::keyClicks(in, "(begin (define a I) (first a))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -310,6 +344,20 @@ int NotebookTest::findLines(QGraphicsScene * scene, QRectF bbox, qreal margin){
     }
   }
 
+  // lines batched into plot items
+  QRectF area = bbox.marginsAdded(margins);
+  foreach(auto item, scene->items()){
+    if(item->type() == PlotItem::Type){
+      for(auto & batch : static_cast<PlotItem *>(item)->batches()){
+        for(std::size_t i = 0; !batch.points && i + 1 < batch.vertices.size(); i += 2){
+          if(area.contains(batch.vertices[i]) && area.contains(batch.vertices[i + 1])){
+            numlines += 1;
+          }
+        }
+      }
+    }
+  }
+
   return numlines;
 }
 
@@ -329,6 +377,22 @@ int NotebookTest::findPoints(QGraphicsScene * scene, QPointF center, qreal radiu
     }
   }
 
+  // points batched into plot items
+  QRectF area(center.x()-radius, center.y()-radius, 2*radius, 2*radius);
+  foreach(auto item, scene->items()){
+    if(item->type() == PlotItem::Type){
+      for(auto & batch : static_cast<PlotItem *>(item)->batches()){
+        for(std::size_t i = 0; batch.points && i < batch.vertices.size(); ++i){
+          QPointF p = batch.vertices[i];
+          double r = batch.width/2;
+          if(area.contains(QRectF(p.x()-r, p.y()-r, 2*r, 2*r))){
+            numpoints += 1;
+          }
+        }
+      }
+    }
+  }
+
   return numpoints;
 }
 
@@ -381,13 +445,14 @@ void NotebookTest::testDiscretePlot() {
                         (list \"abscissa-label\" \"X Label\")\
                         (list \"ordinate-label\" \"Y Label\") ))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto scene = out->scene;
 
   // first check total number of items
-  // 8 lines + 2 points + 7 text = 17
+  // 1 frame item (6 lines) + 1 series item (2 lines + 2 points) + 7 text = 9
   auto itemList = scene->items();
-  QCOMPARE(itemList.size(), 17);
+  QCOMPARE(itemList.size(), 9);
 
   // make them all selectable
   foreach(auto item, itemList){
@@ -460,13 +525,14 @@ void NotebookTest::testContinuousPlot() {
                         (list \"abscissa-label\" \"x\")\
                         (list \"ordinate-label\" \"y\") )))");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto scene = out->scene;
 
   // first check total number of items
-  // 56 lines + 7 text = 63
+  // 1 plot item (6 frame lines) + 1 curve item (50 lines) + 7 text = 9
   auto itemList = scene->items();
-  QCOMPARE(itemList.size(), 63);
+  QCOMPARE(itemList.size(), 9);
 
   // make them all selectable
   foreach(auto item, itemList){
@@ -532,6 +598,7 @@ void NotebookTest::testStopStart() {
 
   QTest::keyClicks(in, "(cos pi)");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -539,6 +606,7 @@ void NotebookTest::testStopStart() {
 
   QTest::mouseClick(stop_button, Qt::LeftButton, Qt::NoModifier, QPoint(0, 0), 4);
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   itemList = out->scene->items();
   item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -546,6 +614,7 @@ void NotebookTest::testStopStart() {
 
   QTest::mouseClick(start_button, Qt::LeftButton, Qt::NoModifier, QPoint(0, 0), 4);
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   itemList = out->scene->items();
   item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -562,6 +631,7 @@ void NotebookTest::testReset() {
 
   QTest::keyClicks(in, "(cos pi)");
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   auto itemList = out->scene->items();
   auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -569,6 +639,7 @@ void NotebookTest::testReset() {
 
   QTest::mouseClick(reset_button, Qt::LeftButton, Qt::NoModifier, QPoint(0, 0), 4);
   QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
 
   itemList = out->scene->items();
   item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
@@ -576,5 +647,315 @@ void NotebookTest::testReset() {
 
 }
 
+void NotebookTest::testResetWhileRunning() {
+
+  in->clear();
+
+  auto reset_button = notebook.findChild<QPushButton *>(QString("reset"));
+
+  // an evaluation running for minutes, with another queued behind it
+  QTest::keyClicks(in, "(begin (define zero (lambda (x) 0)) (length (filter zero (range 0 2000000000 1))))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QVERIFY(out->busy());
+
+  // the reset interrupts it instead of waiting for it and the queued program
+  QElapsedTimer clock;
+  clock.start();
+  QTest::mouseClick(reset_button, Qt::LeftButton, Qt::NoModifier, QPoint(0, 0), 4);
+  QVERIFY(clock.elapsed() < 5000);
+  QVERIFY(!out->busy());
+
+  // the new kernel evaluates at once
+  in->clear();
+  QTest::keyClicks(in, "(cos pi)");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+
+  auto itemList = out->scene->items();
+  auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
+  QCOMPARE(QString(item->toPlainText()), QString("(-1)"));
+}
+
+void NotebookTest::testBusyIndicator() {
+
+  in->clear();
+
+  auto busy_label = notebook.findChild<QLabel *>(QString("busy"));
+  QVERIFY2(busy_label, "Could not find busy indicator");
+
+  QTest::keyClicks(in, "(begin (define f (lambda (x) (sin x))) (continuous-plot f (list 0 10)))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+
+  // the result has not been drawn yet, the GUI is free to repaint
+  QVERIFY(out->busy());
+  QVERIFY(busy_label->isVisibleTo(&notebook));
+
+  QTRY_VERIFY(!out->busy());
+  QVERIFY(!busy_label->isVisibleTo(&notebook));
+
+  // 1 frame item + 1 curve item + 4 bound labels
+  QCOMPARE(out->scene->items().size(), 6);
+}
+
+void NotebookTest::testInterrupt() {
+
+  in->clear();
+
+  auto interrupt_button = notebook.findChild<QPushButton *>(QString("interrupt"));
+
+  QTest::keyClicks(in, "(begin (define a 1) (define f (lambda (x) (+ x a))) (length (map f (range 0 100000000 1))))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+
+  // a click before the kernel starts evaluating has no effect, so keep clicking
+  for (int i = 0; i < 500 && out->busy(); ++i) {
+    QTest::mouseClick(interrupt_button, Qt::LeftButton, Qt::NoModifier, QPoint(0, 0), 10);
+  }
+  QTRY_VERIFY(!out->busy());
+
+  auto itemList = out->scene->items();
+  auto item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
+  QCOMPARE(QString(item->toPlainText()), QString("Error during evaluation: interrupted"));
+
+  // the kernel and its environment are still there
+  in->clear();
+  QTest::keyClicks(in, "(begin a)");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+
+  itemList = out->scene->items();
+  item = dynamic_cast<QGraphicsTextItem *>(itemList.front());
+  QCOMPARE(QString(item->toPlainText()), QString("(1)"));
+}
+
+void NotebookTest::testStreamedPlot() {
+
+  in->clear();
+
+  QTest::keyClicks(in, "(begin (define f (lambda (x) (list x (sin x))))\
+                        (discrete-plot (map f (range 0 9999 1)) (list (list \"resolution\" 0))))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+
+  // the plot arrived in several chunks, each drawn as one item, none twice
+  int plot_items = 0;
+  int points = 0;
+  foreach(auto item, out->scene->items()){
+    if(item->type() == PlotItem::Type){
+      plot_items += 1;
+      for(auto & batch : static_cast<PlotItem *>(item)->batches()){
+        if(batch.points) points += batch.vertices.size();
+      }
+    }
+  }
+  QVERIFY(plot_items > 1);
+  QCOMPARE(points, 10000);
+}
+
+void NotebookTest::testPlotValueUnderMouse() {
+
+  in->clear();
+
+  QTest::keyClicks(in, "(discrete-plot (list (list 1 1) (list 2 4) (list 3 9)))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+
+  // each drawn data point gives back its data coordinates
+  QList<QPointF> values;
+  foreach(auto item, out->scene->items()){
+    if(item->type() == PlotItem::Type){
+      auto plot = static_cast<PlotItem *>(item);
+      for(auto & batch : plot->batches()){
+        if(!batch.points) continue;
+        for(auto & vertex : batch.vertices){
+          QPointF found, value;
+          QVERIFY(plot->nearest(vertex, 1e-6, found, value));
+          QCOMPARE(found, vertex);
+          values.append(value);
+        }
+      }
+    }
+  }
+  QCOMPARE(values.size(), 3);
+  QVERIFY(values.contains(QPointF(2, 4)));
+
+  // the stem bases and frame have no values of their own
+  foreach(auto item, out->scene->items()){
+    if(item->type() == PlotItem::Type){
+      auto plot = static_cast<PlotItem *>(item);
+      for(auto & batch : plot->batches()){
+        for(auto & vertex : batch.vertices){
+          QPointF found, value;
+          if(plot->nearest(vertex, 1e-6, found, value)) QVERIFY(values.contains(value));
+        }
+      }
+    }
+  }
+}
+
+void NotebookTest::testResampleOnZoom() {
+
+  in->clear();
+
+  QTest::keyClicks(in, "(begin (define f (lambda (x) (sin x))) (continuous-plot f (list 0 10)))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+
+  // the lines of the curve item, the only one with a sampler id
+  auto curveLines = [this](){
+    int lines = 0;
+    foreach(auto item, out->scene->items()){
+      if(item->type() == PlotItem::Type && static_cast<PlotItem *>(item)->sampler() != 0){
+        for(auto & batch : static_cast<PlotItem *>(item)->batches()){
+          if(!batch.points) lines += batch.vertices.size() / 2;
+        }
+      }
+    }
+    return lines;
+  };
+  QCOMPARE(curveLines(), 50);
+
+  // zoomed in, the curve is sampled again more finely and replaced in place
+  int items = out->scene->items().size();
+  out->view->scale(8, 8);
+  QMetaObject::invokeMethod(out, "request_resample");
+  QTRY_VERIFY(curveLines() > 50);
+  QCOMPARE(out->scene->items().size(), items);
+}
+
+void NotebookTest::testTiledPlotItem() {
+
+  QGraphicsScene scene;
+  auto item = new PlotItem;
+  for(int i = 0; i < 100; ++i){
+    item->add_point(QPointF(i % 10, i / 10), 0.5, Qt::black);
+  }
+  item->set_tiled(true);
+  scene.addItem(item);
+
+  auto render = [&scene](){
+    QImage image(200, 200, QImage::Format_ARGB32);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    scene.render(&painter);
+    painter.end();
+
+    int dark = 0;
+    for(int y = 0; y < image.height(); ++y){
+      for(int x = 0; x < image.width(); ++x){
+        if(qGray(image.pixel(x, y)) < 128) dark += 1;
+      }
+    }
+    return dark;
+  };
+
+  // the points are drawn through tiles, which are reused when drawn again
+  int dark = render();
+  QVERIFY(dark > 0);
+  std::size_t tiles = item->tile_count();
+  QVERIFY(tiles > 0);
+  QCOMPARE(render(), dark);
+  QCOMPARE(item->tile_count(), tiles);
+
+  // adding primitives drops the tiles
+  item->add_point(QPointF(20, 20), 0.5, Qt::black);
+  QCOMPARE(item->tile_count(), std::size_t(0));
+}
+
+void NotebookTest::testRetainedScene() {
+
+  in->clear();
+
+  QTest::keyClicks(in, "(discrete-plot (list (list 1 1) (list 2 4)) (list (list \"title\" \"A\")))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+
+  // every item but the title, which is replaced
+  QList<QGraphicsItem *> before;
+  foreach(auto item, out->scene->items()){
+    auto text = dynamic_cast<QGraphicsTextItem *>(item);
+    if(!text || text->toPlainText() != QString("A")) before.append(item);
+  }
+
+  in->clear();
+
+  QTest::keyClicks(in, "(discrete-plot (list (list 1 1) (list 2 4)) (list (list \"title\" \"B\")))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+  auto after = out->scene->items();
+
+  // only the title is drawn again, every other item is kept
+  QCOMPARE(after.size(), before.size() + 1);
+  foreach(auto item, before){
+    QVERIFY(after.contains(item));
+  }
+
+  int titles = 0;
+  foreach(auto item, after){
+    auto text = dynamic_cast<QGraphicsTextItem *>(item);
+    if(text && text->toPlainText() == QString("B")) titles += 1;
+  }
+  QCOMPARE(titles, 1);
+}
+
+void NotebookTest::testRetainedStacking() {
+
+  in->clear();
+
+  QTest::keyClicks(in, "(heatmap-plot (lambda (x y) x) (list 0 1) (list 0 1))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+
+  in->clear();
+
+  // the same bounds keep the frame, only the image is drawn again
+  QTest::keyClicks(in, "(heatmap-plot (lambda (x y) y) (list 0 1) (list 0 1))");
+  QTest::keyPress(in, Qt::Key_Return, Qt::ShiftModifier, 4);
+  QTRY_VERIFY(!out->busy());
+
+  QGraphicsPixmapItem * image = nullptr;
+  foreach(auto item, out->scene->items()){
+    if(item->type() == QGraphicsPixmapItem::Type) image = static_cast<QGraphicsPixmapItem *>(item);
+  }
+  QVERIFY(image);
+
+  // and stays below the kept frame, as it was first drawn
+  foreach(auto item, out->scene->items()){
+    if(item != image) QVERIFY(item->zValue() > image->zValue());
+  }
+}
+
+void NotebookTest::testRenderThread() {
+
+  Interpreter interp;
+  std::istringstream program("(list (make-point 0 0) (make-line (make-point 0 0) (make-point 1 1)))");
+  QVERIFY(interp.parseStream(program));
+
+  RenderJob job;
+  job.kind = RenderJob::RESULT;
+  job.generation = 1;
+  job.result = interp.evaluate();
+
+  // the result is rendered on another thread, without a scene
+  ThreadSafeQueue<RenderJob> jobs;
+  ThreadSafeQueue<std::shared_ptr<Rendered>> done;
+  Renderer renderer(&jobs, &done, std::function<void()>());
+  std::shared_ptr<Rendered> rendered;
+  std::thread worker([&](){ rendered = renderer.render(job); });
+  worker.join();
+
+  QVERIFY(rendered != nullptr);
+  QVERIFY(!rendered->message);
+  QCOMPARE(rendered->groups.size(), std::size_t(2));
+
+  // and shown on this one, each rendering once
+  QGraphicsScene scene;
+  for(auto & group : rendered->groups){
+    QCOMPARE(group.rendering->show(&scene).size(), std::size_t(1));
+  }
+  QCOMPARE(scene.items().size(), 2);
+  QVERIFY(rendered->groups[0].rendering->show(&scene).empty());
+}
+
 QTEST_MAIN(NotebookTest)
 #include "notebook_test.moc"
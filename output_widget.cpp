@@ -3,12 +3,68 @@
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QGraphicsTextItem>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <QGridLayout>
-
+#include <QMetaObject>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QToolTip>
+#include <QTimer>
+#include <sstream>
+#include <unordered_map>
+#include <functional>
+
+#include "plot.hpp"
+#include "plot_item.hpp"
 #include "semantic_error.hpp"
 
-OutputWidget::OutputWidget(QWidget * parent) : QWidget(parent) {
+// minimum time between refitting the view while a plot streams in
+const qint64 PLOT_REPAINT_MS = 50;
+
+// zoom factor per eighth of a degree turned on the mouse wheel
+const double ZOOM_PER_STEP = 1.0015;
+
+// distance in pixels within which the data point under the mouse is shown
+const double HOVER_PIXELS = 8;
+
+// time the view must stay still before its curves are sampled again
+const int RESAMPLE_DELAY_MS = 200;
+
+// queues the chunks of plots and the re-sampled curves on the kernel thread
+// for the render thread
+class QueuePlotSink: public PlotSink {
+public:
+
+  QueuePlotSink(ThreadSafeQueue<RenderJob> * jobs, std::size_t generation):
+    jobs(jobs), generation(generation) {}
+
+  void receive(std::size_t stream, std::shared_ptr<const PlotData> chunk, bool last) {
+    RenderJob job;
+    job.kind = RenderJob::CHUNK;
+    job.generation = generation;
+    job.chunk.stream = stream;
+    job.chunk.data = chunk;
+    job.chunk.last = last;
+    jobs->push(job);
+  }
+
+  void resampled(std::shared_ptr<const PlotData> curves) {
+    RenderJob job;
+    job.kind = RenderJob::CURVES;
+    job.generation = generation;
+    job.curves = curves;
+    jobs->push(job);
+  }
+
+private:
+
+  ThreadSafeQueue<RenderJob> * jobs;
+  std::size_t generation;
+};
+
+OutputWidget::OutputWidget(QWidget * parent) : QWidget(parent), rendered_scheduled(false) {
 
   scene = new QGraphicsScene;
   view = new QGraphicsView(scene);
@@ -16,138 +72,146 @@ OutputWidget::OutputWidget(QWidget * parent) : QWidget(parent) {
   view->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
   view->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
+  // drag to pan, wheel to zoom about the mouse, hover to read a data point
+  view->setDragMode(QGraphicsView::ScrollHandDrag);
+  view->setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+  view->viewport()->setMouseTracking(true);
+  view->viewport()->installEventFilter(this);
+
+  resample_timer = new QTimer(this);
+  resample_timer->setSingleShot(true);
+  resample_timer->setInterval(RESAMPLE_DELAY_MS);
+  connect(resample_timer, &QTimer::timeout, this, &OutputWidget::request_resample);
+
   auto layout = new QGridLayout;
   layout->addWidget(view, 0, 0);
 
   setLayout(layout);
 
-  interp = Interpreter(&program_queue, &expression_queue);
+  render_th = std::thread(Renderer(&render_jobs, &rendered_queue, [this]() {
+    if (!rendered_scheduled.exchange(true)) {
+      QMetaObject::invokeMethod(this, "show_rendered", Qt::QueuedConnection);
+    }
+  }));
+
+  interp = make_kernel();
 
   interp_th = std::thread(interp);
 
 }
 
 OutputWidget::~OutputWidget() {
-  program_queue.push("%stop");
-  interp_th.join();
+  join_kernel();
+
+  RenderJob stop;
+  stop.kind = RenderJob::STOP;
+  render_jobs.push(stop);
+  render_th.join();
 }
 
 void OutputWidget::resizeEvent(QResizeEvent * event) {
   this->QWidget::resizeEvent(event);
   view->fitInView(scene->itemsBoundingRect(), Qt::KeepAspectRatio);
+  resample_timer->start();
 }
 
-void OutputWidget::handle_point(Expression & exp) {
-  double x = exp.tailConstBegin()->head().asNumber();
-  double y = (exp.tailConstEnd() - 1)->head().asNumber();
-  double diameter = exp.get_property(Atom("\"size\"")).head().asNumber();
-  double radius = diameter / 2;
-
-  double x_center = x - radius;
-  double y_center = y - radius;
-  double width = diameter;
-  double height = diameter;
-
-  if (!(diameter < 0.)) {
-    QGraphicsEllipseItem * point = scene->addEllipse(x_center, y_center, width, height);
-    point->setBrush(Qt::black);
-    QPen pen;
-    pen.setWidth(0);
-    pen.setBrush(Qt::black);
-    point->setPen(pen);
+bool OutputWidget::eventFilter(QObject * watched, QEvent * event) {
+  if (watched == view->viewport()) {
+    if (event->type() == QEvent::Wheel) {
+      auto wheel = static_cast<QWheelEvent *>(event);
+      double factor = std::pow(ZOOM_PER_STEP, wheel->angleDelta().y());
+      view->scale(factor, factor);
+      resample_timer->start();
+      return true;
+    }
+    if (event->type() == QEvent::MouseButtonRelease) {
+      resample_timer->start();
+    }
+    if (event->type() == QEvent::MouseMove) {
+      auto move = static_cast<QMouseEvent *>(event);
+      if (move->buttons() == Qt::NoButton) show_value(move->pos(), move->globalPos());
+    }
   }
-  else scene->addText("Error: Point size is not a positive number.");
- }
+  return QWidget::eventFilter(watched, event);
+}
 
-void OutputWidget::handle_line(Expression & exp) {
-  double x1 = exp.tailConstBegin()->tailConstBegin()->head().asNumber();
-  double y1 = (exp.tailConstBegin()->tailConstEnd() - 1)->head().asNumber();
-  double x2 = (exp.tailConstEnd() - 1)->tailConstBegin()->head().asNumber();
-  double y2 = ((exp.tailConstEnd() - 1)->tailConstEnd() - 1)->head().asNumber();
-  double width = exp.get_property(Atom("\"thickness\"")).head().asNumber();
+// show the data coordinates of the plot point nearest the mouse, if one is close
+void OutputWidget::show_value(const QPoint & position, const QPoint & global) {
+  QPointF at = view->mapToScene(position);
+  double radius = HOVER_PIXELS / std::max(std::abs(view->transform().m11()), 1e-12);
+
+  bool found = false;
+  QPointF best_value;
+  double best_distance = radius;
+  for (QGraphicsItem * item : scene->items()) {
+    auto plot = qgraphicsitem_cast<PlotItem *>(item);
+    QPointF point, value;
+    if (plot && plot->nearest(at, best_distance, point, value)) {
+      found = true;
+      best_value = value;
+      best_distance = std::hypot(point.x() - at.x(), point.y() - at.y());
+    }
+  }
 
-  if (!(width < 0.)) {
-    QGraphicsLineItem * line = scene->addLine(x1, y1, x2, y2);
-    QPen pen;
-    pen.setWidth(width);
-    line->setPen(pen);
+  if (found) {
+    QToolTip::showText(global, QString("(%1, %2)").arg(best_value.x()).arg(best_value.y()), view);
   }
-  else scene->addText("Error: Line thickness is not a positive number.");
+  else QToolTip::hideText();
 }
 
-void OutputWidget::handle_text(Expression & exp) {
-  Expression pos_prop = exp.get_property(Atom("\"position\""));
-  QGraphicsTextItem * text;
-
-  if (pos_prop.get_property(Atom("\"object-name\"")) == Expression(Atom("\"point\""))) {
-    double x = pos_prop.tailConstBegin()->head().asNumber();
-    double y = (pos_prop.tailConstEnd() - 1)->head().asNumber();
-    double height, width;
-    const double PI = std::atan2(0, -1);
-    double scale_val;
-    double rotate_val;
-
-    QFont font("Monospace");
-    font.setStyleHint(QFont::TypeWriter);
-    font.setPointSize(1);
-
-    std::string str = exp.head().asSymbol();
+// show a new result, keeping the items of groups drawn alike for the last one
+// and showing only the others
+void OutputWidget::retain(const std::vector<RenderGroup> & groups) {
+  std::unordered_multimap<std::size_t, std::size_t> shown;
+  for (std::size_t i = 0; i < display.size(); ++i) {
+    shown.emplace(display[i].hash, i);
+  }
 
-    // remove quotations at beginning and end
-    if (str.front() == '"') {
-      str.replace(str.begin(), str.begin() + 1, "");
-      str.replace(str.end() - 1, str.end(), "");
+  std::vector<DisplayGroup> next;
+  std::vector<bool> kept(display.size(), false);
+  for (auto & group : groups) {
+    DisplayGroup entry = {group.hash, {}};
+
+    auto range = shown.equal_range(group.hash);
+    auto match = std::find_if(range.first, range.second, [&](const std::pair<const std::size_t, std::size_t> & s) {
+      return !kept[s.second];
+    });
+    if (match != range.second) {
+      kept[match->second] = true;
+      entry.items = std::move(display[match->second].items);
     }
+    else entry.items = group.rendering->show(scene);
+    next.push_back(std::move(entry));
+  }
 
-    if (exp.get_property(Atom("\"text-rotation\"")).head().isNumber()){
-      rotate_val = (180/PI) * exp.get_property(Atom("\"text-rotation\"")).head().asNumber();
-    }
-    else {
-      rotate_val = 0;
+  for (std::size_t i = 0; i < display.size(); ++i) {
+    if (kept[i]) continue;
+    for (QGraphicsItem * item : display[i].items) {
+      scene->removeItem(item);
+      delete item;
     }
+  }
+  display = std::move(next);
 
-    if (exp.get_property(Atom("\"text-scale\"")).head().isNumber()){
-      scale_val = exp.get_property(Atom("\"text-scale\"")).head().asNumber();
+  // kept items would stay below those drawn now, stack them in result order
+  for (std::size_t g = 0; g < display.size(); ++g) {
+    for (QGraphicsItem * item : display[g].items) {
+      item->setZValue(g);
     }
-    else {
-      scale_val = 1;
-    }
-
-    text = scene->addText(str.c_str());
-    text->setFont(font);
-    text->setScale(scale_val);
-    height = text->boundingRect().height();
-    width = text->boundingRect().width();
-    text->setTransformOriginPoint(QPointF(width/2, height/2));
-    text->setPos(x - (width/2), y - (height/2));
-    text->setRotation(rotate_val);
   }
-  else scene->addText("Error: Invalid position property");
 }
 
-void OutputWidget::process(Expression exp) {
-  std::stringstream result;
-
-  if (exp.get_property(Atom("\"object-name\"")) == Expression(Atom("\"point\""))){
-    handle_point(exp);
-  }
-  else if (exp.get_property(Atom("\"object-name\"")) == Expression(Atom("\"line\""))){
-    handle_line(exp);
-  }
-  else if (exp.get_property(Atom("\"object-name\"")) == Expression(Atom("\"text\""))){
-    handle_text(exp);
-  }
-  else if (exp.isList()) {
-    for(auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it){
-       process(*it);
-    }
-  }
-  else if (!exp.isLambda()) {
-    result << exp;
-		scene->addText(result.str().c_str());
-  }
+// remove every item, retained or not
+void OutputWidget::clear_display() {
+  scene->clear();
+  display.clear();
+}
 
-  view->fitInView(scene->itemsBoundingRect(), Qt::KeepAspectRatio);
+// replace everything shown with a message, retained as a group of its own
+void OutputWidget::show_message(const std::string & message) {
+  clear_display();
+  DisplayGroup group = {std::hash<std::string>()(message), {scene->addText(message.c_str())}};
+  display.push_back(group);
 }
 
 void OutputWidget::eval(std::string s) {
@@ -161,58 +225,247 @@ void OutputWidget::eval(std::string s) {
         running = 0;
       }
       else if (input == "%reset") {
-        program_queue.push("%stop");
-        interp_th.join();
-        interp = Interpreter(&program_queue, &expression_queue);
+        join_kernel();
+        discard_results();
+        interp = make_kernel();
         interp_th = std::thread(interp);
       }
+      else if (input == "%interrupt") {
+        interrupt();
+      }
+      else if (set_budget(*interp.interrupt(), input)) {}
       else {
-        scene->clear();
-        scene->addText("Error: invalid kernel directive");
+        show_message("Error: invalid kernel directive");
         view->fitInView(scene->itemsBoundingRect(), Qt::KeepAspectRatio);
       }
     }
     else {
+      // the result comes back through show_rendered, the GUI keeps running meanwhile
       program_queue.push(input);
-
-      Expression exp;
-      expression_queue.wait_and_pop(exp);
-
-      scene->clear();
-      if(exp.head().asSymbol() == "Error") scene->addText(exp.tailConstBegin()->head().asSymbol().c_str());
-      else process(exp);
-      view->fitInView(scene->itemsBoundingRect(), Qt::KeepAspectRatio);
-        
+      set_pending(pending + 1);
     }
   }
   else {
     if (input.front() == '%') {
       if(input == "%start") {
         running = 1;
-        interp_th.join();
+        join_kernel();
         interp_th = std::thread(interp);
       }
       else if(input == "%stop") {}
       else if (input == "%reset") {
         running = 1;
-        interp_th.join();
-        interp = Interpreter(&program_queue, &expression_queue);
+        join_kernel();
+        discard_results();
+        interp = make_kernel();
         interp_th = std::thread(interp);
       }
+      else if (input == "%interrupt") {}
+      else if (set_budget(*interp.interrupt(), input)) {}
       else {
-        scene->clear();
-        scene->addText("Error: invalid kernel directive");
+        show_message("Error: invalid kernel directive");
         view->fitInView(scene->itemsBoundingRect(), Qt::KeepAspectRatio);
       }
     }
     else {
-      scene->clear();
-      scene->addText("Error: interpreter kernel not running");
+      show_message("Error: interpreter kernel not running");
       view->fitInView(scene->itemsBoundingRect(), Qt::KeepAspectRatio);
     }
   }
 }
 
+bool OutputWidget::busy() const {
+  return pending > 0;
+}
+
+// add what the render thread has rendered to the scene, in the order the
+// kernel sent it
+void OutputWidget::show_rendered() {
+  rendered_scheduled = false;
+
+  std::vector<std::shared_ptr<Rendered>> batch;
+  std::shared_ptr<Rendered> next;
+  while (rendered_queue.try_pop(next)) {
+    if (next->generation == generation) batch.push_back(next);
+  }
+
+  // several results may be waiting, only the newest is drawn
+  std::size_t newest = batch.size();
+  int results = 0;
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    if (batch[i]->kind == RenderJob::RESULT) {
+      newest = i;
+      results += 1;
+    }
+  }
+  set_pending(std::max(pending - results, 0));
+
+  bool chunks = false;
+  bool complete = false;
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    Rendered & rendered = *batch[i];
+    if (rendered.kind == RenderJob::CHUNK) {
+      show_chunk(rendered);
+      chunks = true;
+      complete = rendered.last;
+    }
+    else if (rendered.kind == RenderJob::CURVES) {
+      show_resampled(rendered);
+    }
+    else if (i == newest) {
+      if (rendered.streamed) {}
+      else if (rendered.message) show_message(rendered.text);
+      else retain(rendered.groups);
+    }
+  }
+
+  // the view is refitted for each result, and at most every PLOT_REPAINT_MS while chunks arrive
+  if (newest < batch.size() ||
+      (chunks && (complete || !repaint_clock.isValid() || repaint_clock.elapsed() >= PLOT_REPAINT_MS))) {
+    view->fitInView(scene->itemsBoundingRect(), Qt::KeepAspectRatio);
+    repaint_clock.restart();
+  }
+}
+
+// a plot arriving whole is compared with what is shown, the first chunk of a
+// larger plot replaces it and each chunk is kept as a group
+void OutputWidget::show_chunk(Rendered & chunk) {
+  if (chunk.whole) {
+    retain(chunk.groups);
+    return;
+  }
+
+  if (chunk.first) clear_display();
+  for (auto & group : chunk.groups) {
+    DisplayGroup entry = {group.hash, group.rendering->show(scene)};
+    for (QGraphicsItem * item : entry.items) {
+      item->setZValue(display.size());
+    }
+    display.push_back(std::move(entry));
+  }
+}
+
+// ask the kernel to sample the curves in view again at the view's resolution
+void OutputWidget::request_resample() {
+  if (!running) return;
+
+  // half the visible width either side is sampled too, so short pans stay sharp
+  QRectF visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+  double left = visible.left() - visible.width() / 2;
+  double right = visible.right() + visible.width() / 2;
+  double pixels = 2 * view->viewport()->width();
+
+  for (QGraphicsItem * item : scene->items()) {
+    auto curves = qgraphicsitem_cast<PlotItem *>(item);
+    if (!curves || curves->sampler() == 0) continue;
+
+    double x0 = curves->data_x(left);
+    double x1 = curves->data_x(right);
+    std::ostringstream directive;
+    directive.precision(17);
+    directive << "%resample " << curves->sampler() << " " << std::min(x0, x1) << " "
+              << std::max(x0, x1) << " " << pixels;
+
+    std::string & sent = resample_sent[curves->sampler()];
+    if (sent != directive.str()) {
+      sent = directive.str();
+      program_queue.push(sent);
+    }
+  }
+}
+
+// show re-sampled curves in place of those of the same plot, if it is still shown
+void OutputWidget::show_resampled(Rendered & curves) {
+  auto resampled = [&](QGraphicsItem * item) {
+    auto old = qgraphicsitem_cast<PlotItem *>(item);
+    return old && old->sampler() == curves.sampler;
+  };
+
+  // the new curves join the display group of the old ones, and its place in the stack
+  std::vector<QGraphicsItem *> * group = nullptr;
+  std::size_t z = 0;
+  for (std::size_t g = 0; g < display.size(); ++g) {
+    auto & items = display[g].items;
+    auto old = std::remove_if(items.begin(), items.end(), resampled);
+    if (old != items.end()) {
+      items.erase(old, items.end());
+      group = &items;
+      z = g;
+    }
+  }
+
+  bool shown = false;
+  for (QGraphicsItem * item : scene->items()) {
+    if (resampled(item)) {
+      scene->removeItem(item);
+      delete item;
+      shown = true;
+    }
+  }
+  if (!shown) return;
+
+  for (auto & rendering : curves.groups) {
+    std::vector<QGraphicsItem *> items = rendering.rendering->show(scene);
+    for (QGraphicsItem * item : items) {
+      item->setZValue(z);
+    }
+    if (group) group->insert(group->end(), items.begin(), items.end());
+  }
+}
+
+Interpreter OutputWidget::make_kernel() {
+  std::size_t kernel = ++generation;
+
+  // called on the kernel thread, the result is rendered on the render thread
+  // and drawn later on the GUI thread
+  Interpreter interpreter(&program_queue, &expression_queue, [this, kernel]() {
+    RenderJob job;
+    job.kind = RenderJob::RESULT;
+    job.generation = kernel;
+    if (expression_queue.try_pop(job.result)) render_jobs.push(job);
+  });
+
+  // plots are drawn in chunks as they are built
+  interpreter.set_plot_sink(std::make_shared<QueuePlotSink>(&render_jobs, kernel));
+
+  return interpreter;
+}
+
+void OutputWidget::set_pending(int count) {
+  bool was_busy = busy();
+  pending = count;
+  if (busy() != was_busy) emit evaluating(busy());
+}
+
+// results of programs sent to a kernel that has been replaced are dropped
+void OutputWidget::discard_results() {
+  Expression exp;
+  while (expression_queue.try_pop(exp)) {}
+  RenderJob job;
+  while (render_jobs.try_pop(job)) {}
+  std::shared_ptr<Rendered> rendered;
+  while (rendered_queue.try_pop(rendered)) {}
+  resample_sent.clear();
+  set_pending(0);
+}
+
+// stop the kernel thread without running the programs still queued for it,
+// the evaluation in progress is interrupted and returns an error
+void OutputWidget::join_kernel() {
+  int dropped = 0;
+  std::string program;
+  while (program_queue.try_pop(program)) {
+    if (program.empty() || program[0] != '%') ++dropped;
+  }
+  set_pending(std::max(pending - dropped, 0));
+
+  // an evaluation the kernel is about to start is cancelled too
+  program_queue.push("%stop");
+  interp.interrupt()->cancel();
+  interp_th.join();
+  interp.interrupt()->resume();
+}
+
 void OutputWidget::start_kernel() {
   eval("%start");
 }
@@ -225,4 +478,7 @@ void OutputWidget::reset_kernel() {
   eval("%reset");
 }
 
-void OutputWidget::interrupt() {}
\ No newline at end of file
+// the kernel stops the evaluation in progress and returns an error as its result
+void OutputWidget::interrupt() {
+  interp.interrupt()->request();
+}
\ No newline at end of file
@@ -2,13 +2,23 @@
 #define OUTPUT_WIDGET_H
 
 #include <QWidget>
+#include <QColor>
 #include <QGraphicsTextItem>
+#include <QElapsedTimer>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
 #include <thread>
+#include <vector>
 
 #include "interpreter.hpp"
+#include "render.hpp"
 
 class QGraphicsView;
 class QGraphicsScene;
+class QTimer;
+class PlotData;
 
 class OutputWidget: public QWidget{
 Q_OBJECT
@@ -21,14 +31,19 @@ public:
 
   void resizeEvent(QResizeEvent * event);
 
-  void process(Expression exp);
-  void handle_point(Expression & exp);
-  void handle_line(Expression & exp);
-  void handle_text(Expression & exp);
+  // zooms the view on the mouse wheel and shows the data point under the mouse
+  bool eventFilter(QObject * watched, QEvent * event);
+
+  // true while a program sent to the kernel has not returned its result
+  bool busy() const;
 
   QGraphicsScene * scene;
 	QGraphicsView * view;
 
+signals:
+
+  void evaluating(bool busy);
+
 public slots:
 
   void eval(std::string s);
@@ -38,14 +53,59 @@ public slots:
   void reset_kernel();
   void interrupt();
 
+private slots:
+
+  void show_rendered();
+  void request_resample();
+
 private:
 
+  Interpreter make_kernel();
+  void set_pending(int count);
+  void discard_results();
+  void join_kernel();
+
+  void show_value(const QPoint & position, const QPoint & global);
+
+  // a group of primitives drawn and compared as one, by structural hash
+  struct DisplayGroup {
+    std::size_t hash;
+    std::vector<QGraphicsItem *> items;
+  };
+
+  void show_chunk(Rendered & chunk);
+  void show_resampled(Rendered & curves);
+  void retain(const std::vector<RenderGroup> & groups);
+  void clear_display();
+  void show_message(const std::string & message);
+
   ThreadSafeQueue<std::string> program_queue;
   ThreadSafeQueue<Expression> expression_queue;
+
+  // results, plot chunks and re-sampled curves are rendered on a thread of
+  // their own in the order the kernel sends them, the GUI thread only adds
+  // the rendered items to the scene, one wake up for all queued meanwhile
+  ThreadSafeQueue<RenderJob> render_jobs;
+  ThreadSafeQueue<std::shared_ptr<Rendered>> rendered_queue;
+  std::atomic<bool> rendered_scheduled;
+  std::size_t generation = 0;
+
+  // continuous plot curves are sampled again once zooming and panning settle,
+  // each request sent once per sampler id
+  QTimer * resample_timer;
+  std::map<std::size_t, std::string> resample_sent;
+
+  // limits refitting the view while a plot streams in
+  QElapsedTimer repaint_clock;
+
+  // the groups drawn for the shown result
+  std::vector<DisplayGroup> display;
   int running = 1;
+  int pending = 0;
 
   Interpreter interp;
   std::thread interp_th;
+  std::thread render_th;
 
 };
 
@@ -0,0 +1,114 @@
+/*! \file parallel.hpp
+Defines helper algorithms used to spread work on packed data across threads.
+ */
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+/// Number of elements below which parallel algorithms run sequentially
+const std::size_t PARALLEL_THRESHOLD = 1 << 15;
+
+/*! Run fn over the index range [0, size), split across hardware threads.
+  \param size the number of indices
+  \param threshold the size below which fn runs once on the calling thread
+  \param fn called as fn(begin, end) for each contiguous chunk of indices
+
+  Each thread receives one contiguous chunk, so fn can set up per-thread state
+  once per call. The first exception thrown by any chunk, in index order, is
+  rethrown on the calling thread after all threads have finished.
+*/
+template<typename Function>
+void parallel_for(std::size_t size, std::size_t threshold, Function fn){
+
+  std::size_t nthreads = std::thread::hardware_concurrency();
+  nthreads = std::min(nthreads, size / std::max<std::size_t>(threshold, 1));
+
+  if(size < threshold || nthreads < 2){
+    fn(std::size_t(0), size);
+    return;
+  }
+
+  std::vector<std::exception_ptr> errors(nthreads);
+  std::vector<std::thread> workers;
+  for(std::size_t i = 0; i < nthreads; ++i){
+    std::size_t begin = (size * i) / nthreads;
+    std::size_t end = (size * (i + 1)) / nthreads;
+    std::exception_ptr & error = errors[i];
+    workers.emplace_back([begin, end, &fn, &error](){
+      try{
+        fn(begin, end);
+      }
+      catch(...){
+        error = std::current_exception();
+      }
+    });
+  }
+  for(auto & w : workers){
+    w.join();
+  }
+
+  for(auto & error : errors){
+    if(error) std::rethrow_exception(error);
+  }
+}
+
+/*! Stable sort of a random access range, split across hardware threads.
+  \param first the beginning of the range
+  \param last the end of the range
+  \param comp the strict weak ordering to sort by
+
+  Each thread stable sorts one contiguous chunk, then neighbouring chunks are
+  merged pairwise with std::inplace_merge, which preserves stability. Ranges
+  smaller than PARALLEL_THRESHOLD are sorted on the calling thread.
+*/
+template<typename RandomIt, typename Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp){
+
+  std::size_t size = std::distance(first, last);
+  std::size_t nthreads = std::thread::hardware_concurrency();
+
+  if(size < PARALLEL_THRESHOLD || nthreads < 2){
+    std::stable_sort(first, last, comp);
+    return;
+  }
+
+  // chunk boundaries, nthreads + 1 entries
+  std::vector<RandomIt> bounds;
+  for(std::size_t i = 0; i < nthreads; ++i){
+    bounds.push_back(first + (size * i) / nthreads);
+  }
+  bounds.push_back(last);
+
+  std::vector<std::thread> workers;
+  for(std::size_t i = 0; i < nthreads; ++i){
+    RandomIt begin = bounds[i];
+    RandomIt end = bounds[i + 1];
+    workers.emplace_back([begin, end, comp](){ std::stable_sort(begin, end, comp); });
+  }
+  for(auto & w : workers){
+    w.join();
+  }
+
+  // merge sorted chunks pairwise until one remains
+  for(std::size_t width = 1; width < nthreads; width *= 2){
+    for(std::size_t i = 0; i + width < nthreads; i += 2 * width){
+      std::size_t j = std::min(i + 2 * width, nthreads);
+      std::inplace_merge(bounds[i], bounds[i + width], bounds[j], comp);
+    }
+  }
+}
+
+/// Ascending stable sort of a random access range, split across hardware threads
+template<typename RandomIt>
+void parallel_sort(RandomIt first, RandomIt last){
+  typedef typename std::iterator_traits<RandomIt>::value_type ValueType;
+  parallel_sort(first, last, [](const ValueType & a, const ValueType & b){ return a < b; });
+}
+
+#endif
@@ -0,0 +1,617 @@
+#include "plot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <unordered_map>
+
+#include "hash.hpp"
+#include "parallel.hpp"
+
+// size property of the end points of a line
+const double ENDPOINT_SIZE = 0.5;
+
+namespace {
+
+Expression make_point(double px, double py, double size){
+  Expression point(Atom("list"));
+  point.set_property(Atom("\"object-name\""), Expression(Atom("\"point\"")));
+  point.set_property(Atom("\"size\""), Expression(Atom(size)));
+  point.append(px);
+  point.append(py);
+  return point;
+}
+
+}
+
+std::size_t PlotData::add_vertex(double px, double py){
+  x.push_back(px);
+  y.push_back(py);
+  return x.size() - 1;
+}
+
+std::size_t PlotData::add_style(double width){
+  for(std::size_t i = 0; i < styles.size(); ++i){
+    if(styles[i] == width) return i;
+  }
+  styles.push_back(width);
+  return styles.size() - 1;
+}
+
+void PlotData::add_item(Kind kind, std::size_t index){
+  Item item = {kind, index, m_data};
+  order.push_back(item);
+}
+
+void PlotData::set_data_space(bool data){
+  m_data = data;
+}
+
+void PlotData::begin_series(){
+  Series run = {order.size(), order.size()};
+  series.push_back(run);
+  m_data = true;
+  m_open = true;
+}
+
+void PlotData::end_series(){
+  series.back().end = order.size();
+  m_data = false;
+  m_open = false;
+}
+
+void PlotData::add_point(double px, double py, double size){
+  Point point = {add_vertex(px, py), add_style(size)};
+  points.push_back(point);
+  add_item(POINT, points.size() - 1);
+}
+
+void PlotData::add_line(double x1, double y1, double x2, double y2, double thickness){
+  std::size_t from = add_vertex(x1, y1);
+  Segment segment = {from, add_vertex(x2, y2), add_style(thickness), false};
+  segments.push_back(segment);
+  add_item(LINE, segments.size() - 1);
+}
+
+void PlotData::add_stem(double px, double py, double foot, double thickness){
+  add_line(px, foot, px, py, thickness);
+  segments.back().stem = true;
+}
+
+void PlotData::add_text(const std::string & text, double px, double py, double size, double scale){
+  Label label = {text, add_vertex(px, py), add_style(size), scale, 0, false};
+  labels.push_back(label);
+  add_item(TEXT, labels.size() - 1);
+}
+
+void PlotData::add_text(const std::string & text, double px, double py, double size, double scale, double rotation){
+  add_text(text, px, py, size, scale);
+  labels.back().rotation = rotation;
+  labels.back().rotated = true;
+}
+
+void PlotData::add_image(double px, double py, double width, double height,
+  std::size_t columns, std::size_t rows, std::vector<double> values, Shading shading){
+
+  Image image = {add_vertex(px, py), width, height, columns, rows, std::move(values), shading};
+  images.push_back(std::move(image));
+  add_item(IMAGE, images.size() - 1);
+}
+
+void PlotData::add_polyline(const std::vector<double> & px, const std::vector<double> & py,
+  std::size_t first, std::size_t count, double thickness){
+
+  Polyline polyline = {x.size(), count, add_style(thickness)};
+  for(std::size_t i = first; i < first + count; ++i){
+    add_vertex(px[i], py[i]);
+  }
+  polylines.push_back(polyline);
+  add_item(POLYLINE, polylines.size() - 1);
+}
+
+double PlotData::ViewTransform::map_x(double px) const{
+  // a zero offset is not added, it would turn -0 into 0
+  double vx = px * (px < 0 ? sx_neg : sx);
+  return dx == 0 ? vx : vx + dx;
+}
+
+double PlotData::ViewTransform::map_y(double py) const{
+  double vy = py * (py < 0 ? sy_neg : sy);
+  return dy == 0 ? vy : vy + dy;
+}
+
+PlotData::ViewTransform PlotData::layout_view(double x_min, double x_max, double y_min, double y_max){
+  double x_coeff = 20 / (x_max - x_min);
+  double y_coeff = 20 / (y_max - y_min);
+
+  double right = x_max * x_coeff;
+  double left = x_min * x_coeff;
+  double upper = y_max * y_coeff;
+  double lower = y_min * y_coeff;
+
+  // the scale of one side of 0, the coefficient when the bound on that side is 0
+  auto side = [](double extent, double bound, double coeff){
+    double scale = std::abs(extent) / std::abs(bound);
+    return std::isfinite(scale) ? scale : coeff;
+  };
+
+  // y * (upper / y_max) * -1 is y * -(upper / y_max), negation is exact
+  ViewTransform view = {side(right, x_max, x_coeff), -side(upper, y_max, y_coeff), 0, 0,
+                        side(left, x_min, x_coeff), -side(lower, y_min, y_coeff)};
+  return view;
+}
+
+Expression PlotData::primitive(std::size_t index) const{
+
+  const Item & item = order[index];
+
+  // view coordinates of a vertex of this primitive
+  auto vx = [&](std::size_t v){ return item.data ? view.map_x(x[v]) : x[v]; };
+  auto vy = [&](std::size_t v){ return item.data ? view.map_y(y[v]) : y[v]; };
+
+  if(item.kind == POINT){
+    const Point & point = points[item.index];
+    return make_point(vx(point.vertex), vy(point.vertex), styles[point.style]);
+  }
+
+  if(item.kind == LINE){
+    const Segment & segment = segments[item.index];
+    Expression line(Atom("list"));
+    line.set_property(Atom("\"object-name\""), Expression(Atom("\"line\"")));
+    line.set_property(Atom("\"thickness\""), Expression(Atom(styles[segment.style])));
+    double foot = segment.stem ? y[segment.from] : vy(segment.from);
+    line.append(make_point(vx(segment.from), foot, ENDPOINT_SIZE));
+    line.append(make_point(vx(segment.to), vy(segment.to), ENDPOINT_SIZE));
+    return line;
+  }
+
+  if(item.kind == IMAGE){
+    const Image & image = images[item.index];
+    double width = item.data ? image.width * std::abs(view.sx) : image.width;
+    double height = item.data ? image.height * std::abs(view.sy) : image.height;
+
+    Expression result(Atom("list"));
+    result.set_property(Atom("\"object-name\""), Expression(Atom("\"image\"")));
+    result.set_property(Atom("\"position\""), make_point(vx(image.vertex), vy(image.vertex), 0));
+    result.set_property(Atom("\"width\""), Expression(Atom(width)));
+    result.set_property(Atom("\"height\""), Expression(Atom(height)));
+    result.set_property(Atom("\"shading\""),
+      Expression(Atom(image.shading == LINEAR ? "\"linear\"" : "\"count\"")));
+    for(std::size_t r = 0; r < image.rows; ++r){
+      Expression row(Atom("list"));
+      for(std::size_t c = 0; c < image.columns; ++c){
+        row.append(image.values[r * image.columns + c]);
+      }
+      result.append(row);
+    }
+    return result;
+  }
+
+  if(item.kind == POLYLINE){
+    const Polyline & polyline = polylines[item.index];
+    Expression line(Atom("list"));
+    line.set_property(Atom("\"object-name\""), Expression(Atom("\"polyline\"")));
+    line.set_property(Atom("\"thickness\""), Expression(Atom(styles[polyline.style])));
+    for(std::size_t v = polyline.first; v < polyline.first + polyline.count; ++v){
+      line.append(make_point(vx(v), vy(v), ENDPOINT_SIZE));
+    }
+    return line;
+  }
+
+  const Label & label = labels[item.index];
+  Expression text(Atom(label.text));
+  text.set_property(Atom("\"object-name\""), Expression(Atom("\"text\"")));
+  text.set_property(Atom("\"text-scale\""), Expression(Atom(label.scale)));
+  if(label.rotated){
+    text.set_property(Atom("\"text-rotation\""), Expression(Atom(label.rotation)));
+  }
+  text.set_property(Atom("\"position\""), make_point(vx(label.vertex), vy(label.vertex), styles[label.style]));
+  return text;
+}
+
+std::shared_ptr<PlotData> PlotData::extract(std::size_t begin, std::size_t end) const{
+  auto chunk = std::make_shared<PlotData>();
+  chunk->view = view;
+  chunk->sampler = sampler;
+
+  // every series starting before the run keeps its index, empty if outside the run
+  for(std::size_t s = 0; s < series.size() && series[s].begin < end; ++s){
+    std::size_t last = (m_open && s + 1 == series.size()) ? order.size() : series[s].end;
+    std::size_t lo = std::max(series[s].begin, begin);
+    std::size_t hi = std::min(last, end);
+
+    Series run = {0, 0};
+    if(lo < hi){
+      run.begin = lo - begin;
+      run.end = hi - begin;
+    }
+    chunk->series.push_back(run);
+  }
+
+  for(std::size_t i = begin; i < end; ++i){
+    const Item & item = order[i];
+    chunk->m_data = item.data;
+
+    if(item.kind == POINT){
+      const Point & point = points[item.index];
+      chunk->add_point(x[point.vertex], y[point.vertex], styles[point.style]);
+    }
+    else if(item.kind == LINE){
+      const Segment & segment = segments[item.index];
+      if(segment.stem){
+        chunk->add_stem(x[segment.to], y[segment.to], y[segment.from], styles[segment.style]);
+      }
+      else{
+        chunk->add_line(x[segment.from], y[segment.from], x[segment.to], y[segment.to], styles[segment.style]);
+      }
+    }
+    else if(item.kind == TEXT){
+      const Label & label = labels[item.index];
+      if(label.rotated){
+        chunk->add_text(label.text, x[label.vertex], y[label.vertex], styles[label.style], label.scale, label.rotation);
+      }
+      else{
+        chunk->add_text(label.text, x[label.vertex], y[label.vertex], styles[label.style], label.scale);
+      }
+    }
+    else if(item.kind == IMAGE){
+      const Image & image = images[item.index];
+      chunk->add_image(x[image.vertex], y[image.vertex], image.width, image.height,
+        image.columns, image.rows, image.values, image.shading);
+    }
+    else{
+      const Polyline & polyline = polylines[item.index];
+      chunk->add_polyline(x, y, polyline.first, polyline.count, styles[polyline.style]);
+    }
+  }
+  chunk->m_data = false;
+
+  return chunk;
+}
+
+std::vector<std::size_t> PlotData::groups(std::size_t begin, std::size_t end) const{
+  std::vector<std::size_t> bounds;
+  std::size_t s = 0;
+
+  std::size_t i = begin;
+  while(i < end){
+    bounds.push_back(i);
+    while(s < series.size() && series[s].end <= i) ++s;
+
+    // a series is one group
+    if(s < series.size() && series[s].begin <= i){
+      i = std::min(series[s].end, end);
+      continue;
+    }
+
+    // as is each label and image, and each run of other primitives up to the next series
+    std::size_t next = (s < series.size()) ? std::min(series[s].begin, end) : end;
+    Kind kind = order[i++].kind;
+    if(kind == TEXT || kind == IMAGE) continue;
+    while(i < next && order[i].kind != TEXT && order[i].kind != IMAGE) ++i;
+  }
+  bounds.push_back(end);
+
+  return bounds;
+}
+
+std::size_t PlotData::hash(std::size_t begin, std::size_t end) const{
+  std::size_t seed = 0;
+  hash_combine(seed, end - begin);
+
+  auto vertex = [&](std::size_t v){
+    hash_combine(seed, x[v]);
+    hash_combine(seed, y[v]);
+  };
+
+  std::size_t s = 0;
+  bool data = false;
+  for(std::size_t i = begin; i < end; ++i){
+    const Item & item = order[i];
+
+    // the series sets the color a primitive is drawn in
+    while(s < series.size() && series[s].end <= i) ++s;
+    std::size_t in_series = (s < series.size() && series[s].begin <= i) ? s + 1 : 0;
+
+    hash_combine(seed, static_cast<int>(item.kind));
+    hash_combine(seed, item.data);
+    hash_combine(seed, in_series);
+    data = data || item.data;
+
+    if(item.kind == POINT){
+      vertex(points[item.index].vertex);
+      hash_combine(seed, styles[points[item.index].style]);
+    }
+    else if(item.kind == LINE){
+      const Segment & segment = segments[item.index];
+      vertex(segment.from);
+      vertex(segment.to);
+      hash_combine(seed, segment.stem);
+      hash_combine(seed, styles[segment.style]);
+    }
+    else if(item.kind == TEXT){
+      const Label & label = labels[item.index];
+      hash_combine(seed, label.text);
+      vertex(label.vertex);
+      hash_combine(seed, styles[label.style]);
+      hash_combine(seed, label.scale);
+      hash_combine(seed, label.rotation);
+      hash_combine(seed, label.rotated);
+    }
+    else if(item.kind == IMAGE){
+      const Image & image = images[item.index];
+      vertex(image.vertex);
+      hash_combine(seed, image.width);
+      hash_combine(seed, image.height);
+      hash_combine(seed, image.columns);
+      hash_combine(seed, image.rows);
+      hash_combine(seed, static_cast<int>(image.shading));
+      for(double value : image.values){
+        hash_combine(seed, value);
+      }
+    }
+    else{
+      const Polyline & polyline = polylines[item.index];
+      for(std::size_t v = polyline.first; v < polyline.first + polyline.count; ++v){
+        vertex(v);
+      }
+      hash_combine(seed, styles[polyline.style]);
+    }
+  }
+
+  // data primitives are drawn where the view transform places them
+  if(data){
+    hash_combine(seed, view.sx);
+    hash_combine(seed, view.sy);
+    hash_combine(seed, view.dx);
+    hash_combine(seed, view.dy);
+    hash_combine(seed, view.sx_neg);
+    hash_combine(seed, view.sy_neg);
+    hash_combine(seed, sampler);
+  }
+
+  return seed;
+}
+
+void min_max(const std::vector<double> & values, double & lo, double & hi){
+
+  // independent lanes break the dependency between iterations, so the
+  // compiler can keep them in vector registers
+  const std::size_t LANES = 4;
+  double low[LANES], high[LANES];
+  for(std::size_t k = 0; k < LANES; ++k){
+    low[k] = high[k] = values[0];
+  }
+
+  std::size_t i = 0;
+  for(; i + LANES <= values.size(); i += LANES){
+    for(std::size_t k = 0; k < LANES; ++k){
+      double v = values[i + k];
+      low[k] = (v < low[k]) ? v : low[k];
+      high[k] = (v > high[k]) ? v : high[k];
+    }
+  }
+  for(; i < values.size(); ++i){
+    low[0] = (values[i] < low[0]) ? values[i] : low[0];
+    high[0] = (values[i] > high[0]) ? values[i] : high[0];
+  }
+
+  lo = low[0];
+  hi = high[0];
+  for(std::size_t k = 1; k < LANES; ++k){
+    lo = (low[k] < lo) ? low[k] : lo;
+    hi = (high[k] > hi) ? high[k] : hi;
+  }
+}
+
+std::vector<std::size_t> decimate_min_max(const std::vector<double> & xs, const std::vector<double> & ys,
+  double x_min, double x_max, std::size_t buckets){
+
+  const std::size_t NONE = xs.size();
+  std::vector<std::size_t> lowest(buckets, NONE), highest(buckets, NONE);
+  double width = (x_max - x_min) / buckets;
+
+  for(std::size_t i = 0; i < xs.size(); ++i){
+    if(!(xs[i] >= x_min && xs[i] <= x_max)) continue;
+
+    std::size_t b = 0;
+    if(width > 0){
+      b = std::min(buckets - 1, static_cast<std::size_t>(std::floor((xs[i] - x_min) / width)));
+    }
+
+    if(lowest[b] == NONE || ys[i] < ys[lowest[b]]) lowest[b] = i;
+    if(highest[b] == NONE || ys[i] > ys[highest[b]]) highest[b] = i;
+  }
+
+  std::vector<std::size_t> result;
+  for(std::size_t b = 0; b < buckets; ++b){
+    if(lowest[b] != NONE) result.push_back(lowest[b]);
+    if(highest[b] != NONE && highest[b] != lowest[b]) result.push_back(highest[b]);
+  }
+  std::sort(result.begin(), result.end());
+
+  return result;
+}
+
+std::vector<double> bin_density(const std::vector<double> & xs, const std::vector<double> & ys,
+  double x_min, double x_max, double y_min, double y_max, std::size_t columns, std::size_t rows){
+
+  std::vector<double> counts(columns * rows, 0);
+  std::mutex merge;
+
+  double x_scale = (x_max > x_min) ? columns / (x_max - x_min) : 0;
+  double y_scale = (y_max > y_min) ? rows / (y_max - y_min) : 0;
+
+  // each thread counts its run of points into a private grid, then adds it in
+  parallel_for(xs.size(), PARALLEL_THRESHOLD, [&](std::size_t begin, std::size_t end){
+    std::vector<double> local(columns * rows, 0);
+
+    for(std::size_t i = begin; i < end; ++i){
+      if(!(xs[i] >= x_min && xs[i] <= x_max && ys[i] >= y_min && ys[i] <= y_max)) continue;
+
+      std::size_t c = std::min(columns - 1, static_cast<std::size_t>((xs[i] - x_min) * x_scale));
+      std::size_t r = std::min(rows - 1, static_cast<std::size_t>((y_max - ys[i]) * y_scale));
+      local[r * columns + c] += 1;
+    }
+
+    std::lock_guard<std::mutex> lock(merge);
+    for(std::size_t i = 0; i < local.size(); ++i){
+      counts[i] += local[i];
+    }
+  });
+
+  return counts;
+}
+
+void march_squares(const std::vector<double> & values, std::size_t columns, std::size_t rows, double level,
+  std::vector<double> & xs, std::vector<double> & ys, std::vector<std::size_t> & starts){
+
+  const std::size_t NONE = static_cast<std::size_t>(-1);
+
+  // a crossing on a cell edge, linked to the crossings it is joined to
+  struct Crossing {
+    double x;
+    double y;
+    std::size_t link[2];
+    std::size_t degree;
+    bool used;
+  };
+  std::vector<Crossing> crossings;
+  std::unordered_map<std::size_t, std::size_t> by_edge;
+
+  auto value = [&](std::size_t r, std::size_t c){ return values[r * columns + c]; };
+  auto inside = [&](std::size_t r, std::size_t c){ return value(r, c) >= level; };
+
+  // the crossing on the edge from node (r, c) to its right (across) or down neighbour
+  auto crossing = [&](std::size_t r, std::size_t c, bool across){
+    std::size_t edge = 2 * (r * columns + c) + (across ? 0 : 1);
+    auto found = by_edge.find(edge);
+    if(found != by_edge.end()) return found->second;
+
+    std::size_t r2 = across ? r : r + 1;
+    std::size_t c2 = across ? c + 1 : c;
+    double t = (level - value(r, c)) / (value(r2, c2) - value(r, c));
+
+    Crossing point = {c + t * (c2 - c), r + t * (r2 - r), {NONE, NONE}, 0, false};
+    crossings.push_back(point);
+    by_edge[edge] = crossings.size() - 1;
+    return crossings.size() - 1;
+  };
+
+  auto join = [&](std::size_t a, std::size_t b){
+    if(crossings[a].degree < 2) crossings[a].link[crossings[a].degree++] = b;
+    if(crossings[b].degree < 2) crossings[b].link[crossings[b].degree++] = a;
+  };
+
+  for(std::size_t r = 0; r + 1 < rows; ++r){
+    for(std::size_t c = 0; c + 1 < columns; ++c){
+      bool tl = inside(r, c), tr = inside(r, c + 1);
+      bool br = inside(r + 1, c + 1), bl = inside(r + 1, c);
+
+      // the crossed edges in order top, right, bottom, left
+      std::size_t edges[4];
+      std::size_t count = 0;
+      if(tl != tr) edges[count++] = crossing(r, c, true);
+      if(tr != br) edges[count++] = crossing(r, c + 1, false);
+      if(bl != br) edges[count++] = crossing(r + 1, c, true);
+      if(tl != bl) edges[count++] = crossing(r, c, false);
+
+      if(count == 2){
+        join(edges[0], edges[1]);
+      }
+      else if(count == 4){
+        // saddle, the center decides which opposite corners are connected
+        double center = (value(r, c) + value(r, c + 1) + value(r + 1, c + 1) + value(r + 1, c)) / 4;
+        if((center >= level) == tl){
+          join(edges[0], edges[1]);
+          join(edges[2], edges[3]);
+        }
+        else{
+          join(edges[3], edges[0]);
+          join(edges[1], edges[2]);
+        }
+      }
+    }
+  }
+
+  // walk from a crossing along unused links, closing the line if it returns
+  auto walk = [&](std::size_t start){
+    starts.push_back(xs.size());
+    std::size_t current = start;
+    while(current != NONE){
+      Crossing & point = crossings[current];
+      point.used = true;
+      xs.push_back(point.x);
+      ys.push_back(point.y);
+
+      std::size_t next = NONE;
+      for(std::size_t k = 0; k < point.degree; ++k){
+        if(!crossings[point.link[k]].used) next = point.link[k];
+      }
+      if(next == NONE && point.degree == 2 && current != start && xs.size() - starts.back() > 2 &&
+         (point.link[0] == start || point.link[1] == start)){
+        xs.push_back(crossings[start].x);
+        ys.push_back(crossings[start].y);
+      }
+      current = next;
+    }
+  };
+
+  // open lines start at their ends, whatever remains are closed loops
+  for(std::size_t i = 0; i < crossings.size(); ++i){
+    if(!crossings[i].used && crossings[i].degree == 1) walk(i);
+  }
+  for(std::size_t i = 0; i < crossings.size(); ++i){
+    if(!crossings[i].used && crossings[i].degree == 2) walk(i);
+  }
+}
+
+// serials are unique across the process, a plot freed mid-program may leave
+// its address to the next, never its serial
+static std::atomic<std::size_t> next_stream_serial(1);
+
+PlotStream::PlotStream(PlotSink * sink, PlotData & plot):
+  m_sink(sink), m_plot(plot), m_serial(next_stream_serial++), m_published(0){
+  plot.stream = m_serial;
+}
+
+void PlotStream::flush(){
+  if(!m_sink || m_plot.order.size() - m_published < PLOT_STREAM_CHUNK) return;
+
+  m_sink->receive(m_serial, m_plot.extract(m_published, m_plot.order.size()), false);
+  m_published = m_plot.order.size();
+}
+
+void PlotStream::finish(){
+  if(!m_sink) return;
+
+  m_sink->receive(m_serial, m_plot.extract(m_published, m_plot.order.size()), true);
+  m_published = m_plot.order.size();
+}
+
+PlotSequence::PlotSequence(std::shared_ptr<const PlotData> data):
+  m_data(data), m_offset(0), m_size(data->order.size()){}
+
+PlotSequence::PlotSequence(std::shared_ptr<const PlotData> data, std::size_t offset, std::size_t size):
+  m_data(data), m_offset(offset), m_size(size){}
+
+std::size_t PlotSequence::size() const noexcept{
+  return m_size;
+}
+
+Expression PlotSequence::at(std::size_t index) const{
+  return m_data->primitive(m_offset + index);
+}
+
+std::shared_ptr<const Sequence> PlotSequence::slice(std::size_t begin, std::size_t end) const{
+  return std::shared_ptr<const Sequence>(new PlotSequence(m_data, m_offset + begin, end - begin));
+}
+
+const PlotData & PlotSequence::data() const noexcept{
+  return *m_data;
+}
+
+std::size_t PlotSequence::offset() const noexcept{
+  return m_offset;
+}
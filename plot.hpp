@@ -0,0 +1,382 @@
+/*! \file plot.hpp
+Defines the typed storage of plot primitives produced by the plot procedures.
+
+The plot procedures write points, lines and text labels straight into flat
+arrays. The result is exposed to the interpreter as a list Sequence whose
+elements are converted to the legacy point, line and text Expressions only
+when they are read, while the notebook draws from the arrays directly.
+ */
+#ifndef PLOT_HPP
+#define PLOT_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sequence.hpp"
+
+/// thickness of all plot lines, 0 for the thinnest line the front end draws
+const double PLOT_LINE_THICKNESS = 0;
+
+/*! \class PlotData
+\brief Struct-of-arrays storage for the primitives of one plot.
+
+Every point, line end, label anchor and image corner is a vertex in the
+coordinate arrays. Points, segments and labels refer to vertices by index and
+to a width in the style table, which holds the few distinct point sizes and
+line thicknesses.
+The order array records the kind and index of each primitive in the order it
+was added, which is the order of the list elements.
+
+Primitives showing the data keep the data coordinates and are placed in view
+by the plot's affine view transform when they are read or drawn. The frame
+and labels around them are given in view coordinates directly.
+*/
+class PlotData {
+public:
+
+  /// primitive kinds in the order array
+  enum Kind {POINT, LINE, TEXT, IMAGE, POLYLINE};
+
+  /// how image values are shaded, COUNT on a log scale from 0, LINEAR from the smallest to the largest
+  enum Shading {COUNT, LINEAR};
+
+  /// a primitive in list order, index is into points, segments, labels, images or polylines
+  struct Item {
+    Kind kind;
+    std::size_t index;
+    bool data;
+  };
+
+  /// a run of primitives in the order array drawing one data series, end exclusive
+  struct Series {
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  /// maps data coordinates (x, y) to view coordinates (sx * x + dx, sy * y + dy),
+  /// scaling coordinates below 0 by sx_neg and sy_neg instead
+  struct ViewTransform {
+    double sx;
+    double sy;
+    double dx;
+    double dy;
+    double sx_neg;
+    double sy_neg;
+
+    /// the view x coordinate of data x coordinate px
+    double map_x(double px) const;
+
+    /// the view y coordinate of data y coordinate py
+    double map_y(double py) const;
+  };
+
+  /*! The view transform of the plot layout, each axis 20 units long and the
+    y-axis inverted in view. Each side of 0 is scaled by the bound on that
+    side, as x * (right / x_max) and x * (|left| / |x_min|), so the layout is
+    the one the plot procedures have always given, to the bit
+    \param x_min the smallest x of the data
+    \param x_max the largest x of the data
+    \param y_min the smallest y of the data
+    \param y_max the largest y of the data
+  */
+  static ViewTransform layout_view(double x_min, double x_max, double y_min, double y_max);
+
+  /// a point primitive
+  struct Point {
+    std::size_t vertex;
+    std::size_t style;
+  };
+
+  /// a line primitive between two vertices, the from vertex of a stem has its y in view coordinates
+  struct Segment {
+    std::size_t from;
+    std::size_t to;
+    std::size_t style;
+    bool stem;
+  };
+
+  /// a text primitive, style is the size of its position point
+  struct Label {
+    std::string text;
+    std::size_t vertex;
+    std::size_t style;
+    double scale;
+    double rotation;
+    bool rotated;
+  };
+
+  /// a grid of values drawn over a rectangle, vertex is the corner drawn at the top left
+  struct Image {
+    std::size_t vertex;
+    double width;
+    double height;
+    std::size_t columns;
+    std::size_t rows;
+    std::vector<double> values;
+    Shading shading;
+  };
+
+  /// a line through count consecutive vertices starting at first
+  struct Polyline {
+    std::size_t first;
+    std::size_t count;
+    std::size_t style;
+  };
+
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<Point> points;
+  std::vector<Segment> segments;
+  std::vector<Label> labels;
+  std::vector<Image> images;
+  std::vector<Polyline> polylines;
+  std::vector<double> styles;
+  std::vector<Item> order;
+
+  std::vector<Series> series;
+
+  /// the transform placing data coordinates in view
+  ViewTransform view = {1, 1, 0, 0, 1, 1};
+
+  /// the unscaled data given to discrete-plot, kept whole when the drawn points are decimated
+  std::vector<double> raw_x;
+  std::vector<double> raw_y;
+
+  /// the index in raw_x and raw_y where each series starts
+  std::vector<std::size_t> raw_series;
+
+  /// the SamplerRegistry id of the curves of a continuous plot, 0 for other plots
+  std::size_t sampler = 0;
+
+  /// the serial of the PlotStream publishing this plot, 0 for a plot not streamed
+  std::size_t stream = 0;
+
+  /// give the coordinates of primitives added from now on in data (true) or view (false) space
+  void set_data_space(bool data);
+
+  /// start a data series, primitives added until end_series are in data space
+  void begin_series();
+
+  /// end the current data series, primitives added after are in view space
+  void end_series();
+
+  /// add a point of the given size at (px, py)
+  void add_point(double px, double py, double size);
+
+  /// add a line of the given thickness from (x1, y1) to (x2, y2)
+  void add_line(double x1, double y1, double x2, double y2, double thickness);
+
+  /// add a stem of the given thickness from (px, foot) to (px, py), foot in view coordinates
+  void add_stem(double px, double py, double foot, double thickness);
+
+  /*! Add a text label
+    \param text the label string, including its quotes
+    \param px the x coordinate of the label center
+    \param py the y coordinate of the label center
+    \param size the size property of the position point
+    \param scale the text-scale property
+  */
+  void add_text(const std::string & text, double px, double py, double size, double scale);
+
+  /// add a text label with a text-rotation property in radians
+  void add_text(const std::string & text, double px, double py, double size, double scale, double rotation);
+
+  /*! Add an image
+    \param px the x coordinate of the top left corner
+    \param py the y coordinate of the top left corner
+    \param width the width of the image, positive
+    \param height the height of the image, positive
+    \param columns the number of values in each row
+    \param rows the number of rows
+    \param values the row major values, the first row at the top
+    \param shading how the values are shaded
+  */
+  void add_image(double px, double py, double width, double height,
+    std::size_t columns, std::size_t rows, std::vector<double> values, Shading shading = COUNT);
+
+  /*! Add a polyline
+    \param px the x coordinates of its vertices
+    \param py the y coordinates of its vertices
+    \param first the index of the first vertex to use
+    \param count the number of vertices to use
+    \param thickness the line thickness
+  */
+  void add_polyline(const std::vector<double> & px, const std::vector<double> & py,
+    std::size_t first, std::size_t count, double thickness);
+
+  /// build the legacy Expression of the primitive at position index in the order, in view coordinates
+  Expression primitive(std::size_t index) const;
+
+  /*! Copy a run of primitives into a plot of their own
+    \param begin the position of the first primitive in the order
+    \param end the position after the last primitive
+    \return a plot with the same view transform holding copies of the primitives,
+      its series numbered as in this plot so they are drawn alike
+  */
+  std::shared_ptr<PlotData> extract(std::size_t begin, std::size_t end) const;
+
+  /*! Split a run of primitives of a finished plot into the groups a front end
+    draws and compares as one: each data series, each label and each image, and
+    the runs of other primitives between them
+    \return the position of the first primitive of each group, followed by end
+  */
+  std::vector<std::size_t> groups(std::size_t begin, std::size_t end) const;
+
+  /// structural hash of a run of primitives of a finished plot, equal for runs drawn alike
+  std::size_t hash(std::size_t begin, std::size_t end) const;
+
+private:
+
+  std::size_t add_vertex(double px, double py);
+  std::size_t add_style(double width);
+  void add_item(Kind kind, std::size_t index);
+
+  bool m_data = false;
+  bool m_open = false;
+};
+
+/*! Find the smallest and largest of a non-empty array of values.
+  \param values the values to scan
+  \param lo set to the smallest value
+  \param hi set to the largest value
+*/
+void min_max(const std::vector<double> & values, double & lo, double & hi);
+
+/*! Choose the samples to draw at a given horizontal resolution.
+  \param xs the sample x values, in any order
+  \param ys the sample y values
+  \param x_min the left edge of the region to draw
+  \param x_max the right edge of the region to draw
+  \param buckets the number of columns the region is drawn in
+  \return the indices of the chosen samples in ascending order
+
+  The region is split into equal width buckets and the samples with the
+  smallest and largest y in each bucket are kept, so every visible extreme
+  survives. Samples outside [x_min, x_max] are dropped.
+*/
+std::vector<std::size_t> decimate_min_max(const std::vector<double> & xs, const std::vector<double> & ys,
+  double x_min, double x_max, std::size_t buckets);
+
+/*! Count the points falling in each cell of a grid over a rectangle.
+  \param xs the point x values
+  \param ys the point y values
+  \param x_min the left edge of the grid
+  \param x_max the right edge of the grid
+  \param y_min the bottom edge of the grid
+  \param y_max the top edge of the grid
+  \param columns the number of cells across
+  \param rows the number of cells down
+  \return the row major counts, the first row at y_max
+
+  Points on the right or top edge count in the last cell, points outside the
+  rectangle are not counted. Large inputs are binned across threads.
+*/
+std::vector<double> bin_density(const std::vector<double> & xs, const std::vector<double> & ys,
+  double x_min, double x_max, double y_min, double y_max, std::size_t columns, std::size_t rows);
+
+/*! Trace the contour lines of a grid of values at one level with marching squares.
+  \param values the row major values at the grid nodes
+  \param columns the number of nodes in each row, at least 2
+  \param rows the number of rows of nodes, at least 2
+  \param level the value to trace
+  \param xs receives the x coordinates of the polyline vertices, in node columns
+  \param ys receives the y coordinates of the polyline vertices, in node rows
+  \param starts receives the index in xs and ys where each polyline starts
+
+  A node is inside the contour when its value is at least level. Crossings
+  are placed on cell edges by linear interpolation, saddle cells are resolved
+  by the average of their corners, and the segments are joined into polylines.
+  A closed contour repeats its first vertex at the end.
+*/
+void march_squares(const std::vector<double> & values, std::size_t columns, std::size_t rows, double level,
+  std::vector<double> & xs, std::vector<double> & ys, std::vector<std::size_t> & starts);
+
+/*! \class PlotSink
+\brief Receives plots in chunks while the plot procedures build them.
+
+A sink is installed in the Environment by a front end that wants to draw a
+plot before its procedure returns. receive is called on the evaluating thread,
+resampled on the kernel thread.
+*/
+class PlotSink {
+public:
+
+  virtual ~PlotSink(){}
+
+  /*! Receive the next chunk of a plot
+    \param stream the serial of the plot's PlotStream, unique in the process and never 0
+    \param chunk copies of the next primitives in list order
+    \param last true for the final chunk of the plot
+  */
+  virtual void receive(std::size_t stream, std::shared_ptr<const PlotData> chunk, bool last) = 0;
+
+  /*! Receive the curves of a continuous plot sampled again by a "%resample" directive
+    \param curves the curves, to draw in place of those with the same sampler id
+  */
+  virtual void resampled(std::shared_ptr<const PlotData> /*curves*/){}
+};
+
+/// number of new primitives a plot procedure collects before publishing them
+const std::size_t PLOT_STREAM_CHUNK = 4096;
+
+/*! \class PlotStream
+\brief Publishes the primitives of a plot being built to a PlotSink in chunks.
+*/
+class PlotStream {
+public:
+
+  /*! Construct a stream for a plot, setting its stream serial
+    \param sink the sink to publish to, or nullptr to publish nothing
+    \param plot the plot being built
+  */
+  PlotStream(PlotSink * sink, PlotData & plot);
+
+  /// publish the primitives added since the last chunk once there are PLOT_STREAM_CHUNK of them
+  void flush();
+
+  /// publish the remaining primitives as the last chunk
+  void finish();
+
+private:
+
+  PlotSink * m_sink;
+  const PlotData & m_plot;
+  std::size_t m_serial;
+  std::size_t m_published;
+};
+
+/*! \class PlotSequence
+\brief View of a run of primitives in shared PlotData, backing a plot list.
+*/
+class PlotSequence: public Sequence {
+public:
+
+  /*! Construct a sequence of all primitives of a plot
+    \param data the finished plot, shared and not copied
+  */
+  PlotSequence(std::shared_ptr<const PlotData> data);
+
+  std::size_t size() const noexcept;
+
+  Expression at(std::size_t index) const;
+
+  std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const;
+
+  /// the underlying plot storage
+  const PlotData & data() const noexcept;
+
+  /// position of the first primitive of this view in the order array
+  std::size_t offset() const noexcept;
+
+private:
+
+  PlotSequence(std::shared_ptr<const PlotData> data, std::size_t offset, std::size_t size);
+
+  std::shared_ptr<const PlotData> m_data;
+  std::size_t m_offset;
+  std::size_t m_size;
+};
+
+#endif
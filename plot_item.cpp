@@ -0,0 +1,326 @@
+#include "plot_item.hpp"
+
+#include <QPainter>
+#include <QPen>
+#include <QStyleOptionGraphicsItem>
+#include <QTransform>
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.hpp"
+
+// batches with fewer vertices are painted whole, culling them costs more than it saves
+const std::size_t PLOT_ITEM_CULL_SIZE = 1024;
+
+// lines longer than this fraction of the item are always painted, not culled by midpoint
+const double PLOT_ITEM_LONG_LINE = 1.0 / 16;
+
+// width and height of a raster tile in pixels
+const int PLOT_TILE_PIXELS = 256;
+
+// most raster tiles cached per item, the least recently drawn are dropped (256 KiB each)
+const std::size_t PLOT_TILE_CACHE = 128;
+
+PlotItem::PlotItem() {
+  // paint is given the exposed region rather than the whole bounding rect
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+void PlotItem::add_point(const QPointF & center, double diameter, const QColor & color) {
+  prepareGeometryChange();
+  m_tiles.clear();
+  batch(true, diameter, color).vertices.push_back(center);
+  extend(center, diameter / 2);
+}
+
+void PlotItem::add_line(const QPointF & from, const QPointF & to, double width, const QColor & color) {
+  prepareGeometryChange();
+  m_tiles.clear();
+  Batch & lines = batch(false, width, color);
+  lines.vertices.push_back(from);
+  lines.vertices.push_back(to);
+  extend(from, width / 2);
+  extend(to, width / 2);
+}
+
+void PlotItem::add_polyline(const std::vector<QPointF> & points, double width, const QColor & color) {
+  prepareGeometryChange();
+  m_tiles.clear();
+  Batch & lines = batch(false, width, color);
+  for (std::size_t i = 0; i + 1 < points.size(); ++i) {
+    lines.vertices.push_back(points[i]);
+    lines.vertices.push_back(points[i + 1]);
+  }
+  for (auto & p : points) {
+    extend(p, width / 2);
+  }
+}
+
+const std::vector<PlotItem::Batch> & PlotItem::batches() const {
+  return m_batches;
+}
+
+QRectF PlotItem::boundingRect() const {
+  if (m_empty) return QRectF();
+  return QRectF(QPointF(m_left, m_top), QPointF(m_right, m_bottom));
+}
+
+void PlotItem::add_value(const QPointF & position, const QPointF & value) {
+  m_positions.push_back(position);
+  m_values.push_back(value);
+}
+
+bool PlotItem::nearest(const QPointF & position, double radius, QPointF & found, QPointF & value) {
+  if (m_values_indexed != m_positions.size()) {
+    std::vector<double> xs, ys;
+    xs.reserve(m_positions.size());
+    ys.reserve(m_positions.size());
+    for (auto & p : m_positions) {
+      xs.push_back(p.x());
+      ys.push_back(p.y());
+    }
+    m_value_index = QuadTree(std::move(xs), std::move(ys));
+    m_values_indexed = m_positions.size();
+  }
+
+  std::size_t i = m_value_index.nearest(position.x(), position.y(), radius);
+  if (i == QuadTree::NONE) return false;
+
+  found = m_positions[i];
+  value = m_values[i];
+  return true;
+}
+
+void PlotItem::set_sampler(std::size_t id, double sx, double dx) {
+  m_sampler = id;
+  m_sx = sx;
+  m_dx = dx;
+}
+
+std::size_t PlotItem::sampler() const {
+  return m_sampler;
+}
+
+double PlotItem::data_x(double x) const {
+  return (x - m_dx) / m_sx;
+}
+
+void PlotItem::set_tiled(bool tiled) {
+  m_tiled = tiled;
+  m_tiles.clear();
+  update();
+}
+
+bool PlotItem::tiled() const {
+  return m_tiled;
+}
+
+std::size_t PlotItem::tile_count() const {
+  return m_tiles.size();
+}
+
+void PlotItem::paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget *) {
+  // indexed here, so drawing only reads the batches and may run on any thread
+  for (auto & b : m_batches) {
+    if (b.vertices.size() >= PLOT_ITEM_CULL_SIZE) build_index(b);
+  }
+
+  if (m_tiled) paint_tiles(painter, option->exposedRect);
+  else draw(painter, option->exposedRect);
+}
+
+// draw the primitives reaching into exposed, culling the indexed batches
+void PlotItem::draw(QPainter * painter, const QRectF & exposed) const {
+  bool whole = exposed.contains(boundingRect());
+
+  for (auto & b : m_batches) {
+    if (b.vertices.empty()) continue;
+
+    const std::vector<QPointF> * vertices = &b.vertices;
+    std::vector<QPointF> culled;
+    if (!whole && b.indexed == b.vertices.size() && b.vertices.size() >= PLOT_ITEM_CULL_SIZE) {
+      culled = visible(b, exposed);
+      vertices = &culled;
+    }
+    if (vertices->empty()) continue;
+
+    // a zero width is a cosmetic one pixel pen, as for QGraphicsLineItem
+    QPen pen(b.color);
+    pen.setWidthF(b.width);
+    if (b.points) {
+      pen.setCapStyle(Qt::RoundCap);
+      painter->setPen(pen);
+      painter->drawPoints(vertices->data(), static_cast<int>(vertices->size()));
+    }
+    else {
+      painter->setPen(pen);
+      painter->drawLines(vertices->data(), static_cast<int>(vertices->size() / 2));
+    }
+  }
+}
+
+// blit the cached tiles covering exposed, rasterizing the missing ones in parallel
+void PlotItem::paint_tiles(QPainter * painter, const QRectF & exposed) {
+  QRectF area = exposed.intersected(boundingRect());
+  if (area.isEmpty()) return;
+
+  double scale = std::abs(painter->worldTransform().m11());
+  int level = static_cast<int>(std::ceil(std::log2(std::max(scale, 1e-9))));
+  double tile_scale = std::ldexp(1.0, level);
+  double extent = PLOT_TILE_PIXELS / tile_scale;
+
+  long long tx0 = static_cast<long long>(std::floor(area.left() / extent));
+  long long tx1 = static_cast<long long>(std::floor(area.right() / extent));
+  long long ty0 = static_cast<long long>(std::floor(area.top() / extent));
+  long long ty1 = static_cast<long long>(std::floor(area.bottom() / extent));
+
+  // more tiles than the cache holds would be rasterized again on every paint
+  if (static_cast<std::size_t>((tx1 - tx0 + 1) * (ty1 - ty0 + 1)) > PLOT_TILE_CACHE / 2) {
+    draw(painter, exposed);
+    return;
+  }
+
+  std::vector<TileKey> keys, missing;
+  for (long long ty = ty0; ty <= ty1; ++ty) {
+    for (long long tx = tx0; tx <= tx1; ++tx) {
+      TileKey key(level, tx, ty);
+      keys.push_back(key);
+      if (m_tiles.find(key) == m_tiles.end()) missing.push_back(key);
+    }
+  }
+
+  // each worker paints its own images, QPainter on a QImage needs no GUI thread
+  std::vector<QImage> images(missing.size());
+  parallel_for(missing.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      images[i] = rasterize(std::get<1>(missing[i]), std::get<2>(missing[i]), tile_scale);
+    }
+  });
+  for (std::size_t i = 0; i < missing.size(); ++i) {
+    Tile tile = {images[i], 0};
+    m_tiles[missing[i]] = tile;
+  }
+
+  painter->save();
+  painter->setRenderHint(QPainter::SmoothPixmapTransform);
+  for (auto & key : keys) {
+    Tile & tile = m_tiles[key];
+    tile.used = ++m_tile_clock;
+    QRectF target(std::get<1>(key) * extent, std::get<2>(key) * extent, extent, extent);
+    painter->drawImage(target, tile.image);
+  }
+  painter->restore();
+
+  while (m_tiles.size() > PLOT_TILE_CACHE) {
+    auto oldest = std::min_element(m_tiles.begin(), m_tiles.end(),
+      [](const std::pair<const TileKey, Tile> & a, const std::pair<const TileKey, Tile> & b) {
+        return a.second.used < b.second.used;
+      });
+    m_tiles.erase(oldest);
+  }
+}
+
+// the tile at (tx, ty) of the grid of tiles drawn at scale pixels per scene unit
+QImage PlotItem::rasterize(long long tx, long long ty, double scale) const {
+  QImage image(PLOT_TILE_PIXELS, PLOT_TILE_PIXELS, QImage::Format_ARGB32_Premultiplied);
+  image.fill(Qt::transparent);
+
+  double extent = PLOT_TILE_PIXELS / scale;
+  QPainter painter(&image);
+  painter.setTransform(QTransform(scale, 0, 0, scale, -tx * PLOT_TILE_PIXELS, -ty * PLOT_TILE_PIXELS));
+  draw(&painter, QRectF(tx * extent, ty * extent, extent, extent));
+  painter.end();
+
+  return image;
+}
+
+int PlotItem::type() const {
+  return Type;
+}
+
+// the batch for a pen, there are only a few distinct pens per plot
+PlotItem::Batch & PlotItem::batch(bool points, double width, const QColor & color) {
+  auto found = std::find_if(m_batches.begin(), m_batches.end(), [&](const Batch & b) {
+    return b.points == points && b.width == width && b.color == color;
+  });
+  if (found != m_batches.end()) return *found;
+
+  Batch b = {points, width, color, {}, QuadTree(), 0, {}, 0};
+  m_batches.push_back(b);
+  return m_batches.back();
+}
+
+// grow the bounds by hand, QRectF::united skips the empty rect of a zero width line end
+void PlotItem::extend(const QPointF & p, double margin) {
+  if (m_empty) {
+    m_left = m_right = p.x();
+    m_top = m_bottom = p.y();
+    m_empty = false;
+  }
+  m_left = std::min(m_left, p.x() - margin);
+  m_right = std::max(m_right, p.x() + margin);
+  m_top = std::min(m_top, p.y() - margin);
+  m_bottom = std::max(m_bottom, p.y() + margin);
+}
+
+// index the points of a batch, or the midpoints of its lines
+void PlotItem::build_index(Batch & b) {
+  if (b.indexed == b.vertices.size()) return;
+
+  std::vector<double> xs, ys;
+  b.long_lines.clear();
+  b.reach = 0;
+  if (b.points) {
+    for (auto & p : b.vertices) {
+      xs.push_back(p.x());
+      ys.push_back(p.y());
+    }
+  }
+  else {
+    double limit = PLOT_ITEM_LONG_LINE * std::max(boundingRect().width(), boundingRect().height());
+    for (std::size_t i = 0; i + 1 < b.vertices.size(); i += 2) {
+      QPointF from = b.vertices[i];
+      QPointF to = b.vertices[i + 1];
+      double half = std::hypot(to.x() - from.x(), to.y() - from.y()) / 2;
+
+      // a long line is left out of the index as NaN and painted always
+      if (half * 2 > limit) {
+        b.long_lines.push_back(i / 2);
+        xs.push_back(NAN);
+        ys.push_back(NAN);
+      }
+      else {
+        b.reach = std::max(b.reach, half);
+        xs.push_back((from.x() + to.x()) / 2);
+        ys.push_back((from.y() + to.y()) / 2);
+      }
+    }
+  }
+
+  b.index = QuadTree(std::move(xs), std::move(ys));
+  b.indexed = b.vertices.size();
+}
+
+// the vertices of the primitives of an indexed batch which may reach into exposed
+std::vector<QPointF> PlotItem::visible(const Batch & b, const QRectF & exposed) const {
+  double margin = b.width / 2 + b.reach;
+  std::vector<std::size_t> hits = b.index.query(exposed.left() - margin, exposed.top() - margin,
+                                                exposed.right() + margin, exposed.bottom() + margin);
+
+  std::vector<QPointF> vertices;
+  if (b.points) {
+    vertices.reserve(hits.size());
+    for (std::size_t i : hits) {
+      vertices.push_back(b.vertices[i]);
+    }
+  }
+  else {
+    hits.insert(hits.end(), b.long_lines.begin(), b.long_lines.end());
+    vertices.reserve(2 * hits.size());
+    for (std::size_t i : hits) {
+      vertices.push_back(b.vertices[2 * i]);
+      vertices.push_back(b.vertices[2 * i + 1]);
+    }
+  }
+  return vertices;
+}
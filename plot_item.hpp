@@ -0,0 +1,118 @@
+#ifndef PLOT_ITEM_H
+#define PLOT_ITEM_H
+
+#include <QGraphicsItem>
+#include <QColor>
+#include <QImage>
+#include <QPointF>
+#include <QRectF>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "quadtree.hpp"
+
+// A single scene item drawing all points and lines of a plot. Primitives
+// sharing a pen are packed into one batch and painted with one drawPoints or
+// drawLines call, instead of one scene item and pen per primitive.
+//
+// Large batches are indexed by a QuadTree so only the primitives in the
+// exposed region are painted when the view is zoomed in. The data points of
+// the plot are indexed too, for finding the value under the mouse.
+//
+// A tiled item is rasterized into QImage tiles on worker threads instead,
+// at the power of two scale nearest above the view's. The tiles are cached,
+// so exposing the item again at a zoom level drawn before only blits images.
+class PlotItem: public QGraphicsItem{
+
+public:
+
+  enum { Type = UserType + 1 };
+
+  // points of diameter width, or lines of thickness width as pairs of ends
+  struct Batch {
+    bool points;
+    double width;
+    QColor color;
+    std::vector<QPointF> vertices;
+
+    // index of the points, or of the line midpoints, built when first painted
+    QuadTree index;
+    std::size_t indexed;
+    // lines too long to cull by their midpoint, and half the longest other line
+    std::vector<std::size_t> long_lines;
+    double reach;
+  };
+
+  PlotItem();
+
+  void add_point(const QPointF & center, double diameter, const QColor & color);
+  void add_line(const QPointF & from, const QPointF & to, double width, const QColor & color);
+  void add_polyline(const std::vector<QPointF> & points, double width, const QColor & color);
+
+  const std::vector<Batch> & batches() const;
+
+  // record the data coordinates value of the point drawn at position
+  void add_value(const QPointF & position, const QPointF & value);
+
+  // find the recorded point nearest position within radius, giving its
+  // position and value, false if there is none
+  bool nearest(const QPointF & position, double radius, QPointF & found, QPointF & value);
+
+  // tag the item as drawing the curves of a continuous plot, which the kernel
+  // can sample again, with the x scale and offset placing them in view
+  void set_sampler(std::size_t id, double sx, double dx);
+
+  // the SamplerRegistry id of the curves drawn, 0 for other items
+  std::size_t sampler() const;
+
+  // the data x coordinate drawn at scene x coordinate x
+  double data_x(double x) const;
+
+  // paint through cached raster tiles (true) or straight from the batches (false)
+  void set_tiled(bool tiled);
+  bool tiled() const;
+
+  // the number of raster tiles cached
+  std::size_t tile_count() const;
+
+  QRectF boundingRect() const;
+  void paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget);
+  int type() const;
+
+private:
+
+  Batch & batch(bool points, double width, const QColor & color);
+  void extend(const QPointF & p, double margin);
+  void build_index(Batch & b);
+  std::vector<QPointF> visible(const Batch & b, const QRectF & exposed) const;
+  void draw(QPainter * painter, const QRectF & exposed) const;
+  void paint_tiles(QPainter * painter, const QRectF & exposed);
+  QImage rasterize(long long tx, long long ty, double scale) const;
+
+  // a tile by zoom level and position in the grid of tiles at that level
+  typedef std::tuple<int, long long, long long> TileKey;
+  struct Tile {
+    QImage image;
+    unsigned long long used;
+  };
+
+  std::vector<Batch> m_batches;
+  std::vector<QPointF> m_positions;
+  std::vector<QPointF> m_values;
+  QuadTree m_value_index;
+  std::size_t m_values_indexed = 0;
+  std::size_t m_sampler = 0;
+  double m_sx = 1;
+  double m_dx = 0;
+  bool m_tiled = false;
+  std::map<TileKey, Tile> m_tiles;
+  unsigned long long m_tile_clock = 0;
+  double m_left = 0;
+  double m_right = 0;
+  double m_top = 0;
+  double m_bottom = 0;
+  bool m_empty = true;
+};
+
+#endif
@@ -0,0 +1,431 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "plot.hpp"
+
+TEST_CASE( "Test PlotData primitives in order", "[plot]" ) {
+
+  auto data = std::make_shared<PlotData>();
+  data->add_point(1, 2, 0.5);
+  data->add_line(0, 0, 3, 4, 0);
+  data->add_text("\"title\"", 5, 6, 0, 1);
+  data->add_text("\"label\"", 7, 8, 0, 2, -1);
+
+  REQUIRE(data->order.size() == 4);
+  REQUIRE(data->x.size() == 5);
+  REQUIRE(data->points.size() == 1);
+  REQUIRE(data->segments.size() == 1);
+  REQUIRE(data->labels.size() == 2);
+
+  INFO("equal widths share one style")
+  REQUIRE(data->styles.size() == 2);
+  REQUIRE(data->labels[0].style == data->segments[0].style);
+
+  PlotSequence plot(data);
+  REQUIRE(plot.size() == 4);
+
+  Expression point = plot.at(0);
+  REQUIRE(point.get_property(Atom("\"object-name\"")) == Expression(Atom("\"point\"")));
+  REQUIRE(point.get_property(Atom("\"size\"")) == Expression(0.5));
+  REQUIRE(point.tailAt(0) == Expression(1.));
+  REQUIRE(point.tailAt(1) == Expression(2.));
+
+  Expression line = plot.at(1);
+  REQUIRE(line.get_property(Atom("\"object-name\"")) == Expression(Atom("\"line\"")));
+  REQUIRE(line.get_property(Atom("\"thickness\"")) == Expression(0.));
+  REQUIRE(line.tailAt(1).tailAt(0) == Expression(3.));
+  REQUIRE(line.tailAt(1).get_property(Atom("\"size\"")) == Expression(0.5));
+
+  Expression text = plot.at(2);
+  REQUIRE(text == Expression(Atom("\"title\"")));
+  REQUIRE(text.get_property(Atom("\"text-scale\"")) == Expression(1.));
+  REQUIRE(text.get_property(Atom("\"text-rotation\"")) == Expression());
+  REQUIRE(text.get_property(Atom("\"position\"")).get_property(Atom("\"size\"")) == Expression(0.));
+
+  REQUIRE(plot.at(3).get_property(Atom("\"text-rotation\"")) == Expression(-1.));
+}
+
+TEST_CASE( "Test PlotSequence slice", "[plot]" ) {
+
+  auto data = std::make_shared<PlotData>();
+  for(int i = 0; i < 10; ++i){
+    data->add_point(i, -i, 0.5);
+  }
+
+  PlotSequence plot(data);
+  auto s = plot.slice(3, 6);
+  REQUIRE(s->size() == 3);
+  REQUIRE(s->at(0).tailAt(0) == Expression(3.));
+
+  auto view = std::dynamic_pointer_cast<const PlotSequence>(s->slice(1, 3));
+  REQUIRE(view);
+  REQUIRE(view->offset() == 4);
+  REQUIRE(&view->data() == data.get());
+}
+
+TEST_CASE( "Test min/max decimation", "[plot]" ) {
+
+  std::vector<double> xs, ys;
+  for(int i = 0; i < 1000; ++i){
+    xs.push_back(i);
+    ys.push_back((i % 7) - 3);
+  }
+  ys[500] = 100;
+  ys[501] = -100;
+
+  auto kept = decimate_min_max(xs, ys, 0, 999, 10);
+
+  INFO("at most two samples per bucket, in ascending order")
+  REQUIRE(kept.size() <= 20);
+  REQUIRE(std::is_sorted(kept.begin(), kept.end()));
+
+  INFO("extremes survive")
+  REQUIRE(std::find(kept.begin(), kept.end(), 500) != kept.end());
+  REQUIRE(std::find(kept.begin(), kept.end(), 501) != kept.end());
+
+  INFO("a zoomed region only keeps samples inside it")
+  auto zoomed = decimate_min_max(xs, ys, 100, 199, 50);
+  REQUIRE(zoomed.size() == 100);
+  REQUIRE(zoomed.front() == 100);
+  REQUIRE(zoomed.back() == 199);
+}
+
+TEST_CASE( "Test density binning", "[plot]" ) {
+
+  std::vector<double> xs = {0, 1, 1, 0.5, 0.9, 2};
+  std::vector<double> ys = {0, 1, 0, 0.5, 0.9, 2};
+
+  auto counts = bin_density(xs, ys, 0, 1, 0, 1, 2, 2);
+  REQUIRE(counts.size() == 4);
+
+  INFO("first row at the top, edges count in the last cell, outside dropped")
+  REQUIRE(counts[0] == 0);
+  REQUIRE(counts[1] == 2);
+  REQUIRE(counts[2] == 1);
+  REQUIRE(counts[3] == 2);
+
+  INFO("a large input gives the same total count")
+  std::vector<double> many_x, many_y;
+  for(int i = 0; i < 100000; ++i){
+    many_x.push_back((i % 317) / 316.);
+    many_y.push_back((i % 211) / 210.);
+  }
+  auto grid = bin_density(many_x, many_y, 0, 1, 0, 1, 16, 16);
+  double total = 0;
+  for(auto c : grid) total += c;
+  REQUIRE(total == 100000);
+}
+
+TEST_CASE( "Test min_max", "[plot]" ) {
+
+  std::vector<double> values = {3, -1, 4, 1, -5, 9, 2, 6, 5};
+  double lo, hi;
+  min_max(values, lo, hi);
+  REQUIRE(lo == -5);
+  REQUIRE(hi == 9);
+
+  std::vector<double> single = {7};
+  min_max(single, lo, hi);
+  REQUIRE(lo == 7);
+  REQUIRE(hi == 7);
+}
+
+TEST_CASE( "Test PlotData view transform", "[plot]" ) {
+
+  auto data = std::make_shared<PlotData>();
+  data->view = {2, -4, 1, 0, 2, -4};
+
+  data->add_line(0, 0, 1, 1, 0);
+  data->set_data_space(true);
+  data->add_line(0, 0, 1, 1, 0);
+  data->add_image(0, 1, 1, 1, 1, 1, {5});
+  data->set_data_space(false);
+
+  INFO("the data keeps its own coordinates")
+  REQUIRE(data->x[3] == 1);
+  REQUIRE(data->y[3] == 1);
+
+  PlotSequence plot(data);
+
+  INFO("view primitives are read as given")
+  REQUIRE(plot.at(0).tailAt(1).tailAt(0) == Expression(1.));
+  REQUIRE(plot.at(0).tailAt(1).tailAt(1) == Expression(1.));
+
+  INFO("data primitives are read through the transform")
+  REQUIRE(plot.at(1).tailAt(1).tailAt(0) == Expression(3.));
+  REQUIRE(plot.at(1).tailAt(1).tailAt(1) == Expression(-4.));
+
+  Expression image = plot.at(2);
+  REQUIRE(image.get_property(Atom("\"position\"")).tailAt(1) == Expression(-4.));
+  REQUIRE(image.get_property(Atom("\"width\"")) == Expression(2.));
+  REQUIRE(image.get_property(Atom("\"height\"")) == Expression(4.));
+}
+
+TEST_CASE( "Test PlotData layout view", "[plot]" ) {
+
+  // the scaling the plot procedures have always used, each side of 0 by its own bound
+  auto scaled = [](double v, double lo, double hi, bool inverted){
+    double coeff = 20 / (hi - lo);
+    double high = hi * coeff;
+    double low = lo * coeff;
+    if (!inverted) {
+      if (v >= 0) return v * (high / hi);
+      return v * (std::abs(low) / std::abs(lo));
+    }
+    if (v >= 0) return v * (high / hi) * -1;
+    return v * (std::abs(low) / std::abs(lo)) * -1;
+  };
+
+  // bounds whose products round differently from a single coefficient, and
+  // bounds on both sides of 0
+  std::vector<std::vector<double>> xss = {{0.3, 0.4, 0.5, 0.7}, {-0.6, -0.2, 0.1, 0.7}};
+  std::vector<std::vector<double>> yss = {{0.15, 0.2, 0.25, 0.35}, {-0.35, 0.55, -0.1, 0.2}};
+
+  for(std::size_t s = 0; s < xss.size(); ++s){
+    const std::vector<double> & xs = xss[s];
+    const std::vector<double> & ys = yss[s];
+    double x_min, x_max, y_min, y_max;
+    min_max(xs, x_min, x_max);
+    min_max(ys, y_min, y_max);
+
+    auto data = std::make_shared<PlotData>();
+    data->view = PlotData::layout_view(x_min, x_max, y_min, y_max);
+    data->begin_series();
+    for(std::size_t i = 0; i < xs.size(); ++i){
+      data->add_point(xs[i], ys[i], 0.5);
+      data->add_stem(xs[i], ys[i], -7, 0);
+    }
+    data->end_series();
+
+    for(std::size_t i = 0; i < xs.size(); ++i){
+      Expression point = data->primitive(2 * i);
+      REQUIRE(point.tailAt(0).head().asNumber() == scaled(xs[i], x_min, x_max, false));
+      REQUIRE(point.tailAt(1).head().asNumber() == scaled(ys[i], y_min, y_max, true));
+
+      INFO("the foot of a stem is in view")
+      Expression stem = data->primitive(2 * i + 1);
+      REQUIRE(stem.tailAt(0).tailAt(0) == point.tailAt(0));
+      REQUIRE(stem.tailAt(0).tailAt(1) == Expression(-7.));
+      REQUIRE(stem.tailAt(1) == point);
+    }
+  }
+
+  INFO("a bound at 0 scales its side by the coefficient")
+  PlotData::ViewTransform view = PlotData::layout_view(-2, 0, 0, 4);
+  REQUIRE(view.map_x(0) == 0);
+  REQUIRE(view.map_x(-2) == -20);
+  REQUIRE(view.map_y(4) == -20);
+}
+
+TEST_CASE( "Test PlotData series", "[plot]" ) {
+
+  PlotData data;
+  data.add_line(0, 0, 1, 1, 0);
+  data.begin_series();
+  data.add_point(1, 1, 0.5);
+  data.add_point(2, 2, 0.5);
+  data.end_series();
+  data.begin_series();
+  data.add_point(3, 3, 0.5);
+  data.end_series();
+  data.add_text("\"1\"", 0, 0, 0.5, 1);
+
+  REQUIRE(data.series.size() == 2);
+  REQUIRE(data.series[0].begin == 1);
+  REQUIRE(data.series[0].end == 3);
+  REQUIRE(data.series[1].begin == 3);
+  REQUIRE(data.series[1].end == 4);
+
+  INFO("only series primitives are in data space")
+  REQUIRE(!data.order[0].data);
+  REQUIRE(data.order[1].data);
+  REQUIRE(data.order[3].data);
+  REQUIRE(!data.order[4].data);
+}
+
+TEST_CASE( "Test marching squares", "[plot]" ) {
+
+  std::vector<double> xs, ys;
+  std::vector<std::size_t> starts;
+
+  INFO("a single raised node gives a closed loop around it")
+  march_squares({0, 0, 0, 0, 1, 0, 0, 0, 0}, 3, 3, 0.5, xs, ys, starts);
+  REQUIRE(starts.size() == 1);
+  REQUIRE(xs.size() == 5);
+  REQUIRE(xs.front() == xs.back());
+  REQUIRE(ys.front() == ys.back());
+  for (std::size_t i = 0; i < xs.size(); ++i) {
+    REQUIRE(std::abs(xs[i] - 1) + std::abs(ys[i] - 1) == 0.5);
+  }
+
+  INFO("a ramp gives an open line across the grid")
+  xs.clear(); ys.clear(); starts.clear();
+  march_squares({0, 1, 0, 1}, 2, 2, 0.25, xs, ys, starts);
+  REQUIRE(starts.size() == 1);
+  REQUIRE(xs.size() == 2);
+  REQUIRE(xs[0] == 0.25);
+  REQUIRE(xs[1] == 0.25);
+
+  INFO("a saddle joins the corners on the side of its center")
+  xs.clear(); ys.clear(); starts.clear();
+  march_squares({1, 0, 0, 1}, 2, 2, 0.5, xs, ys, starts);
+  REQUIRE(starts.size() == 2);
+  REQUIRE(xs.size() == 4);
+  // the top edge crossing is joined to the right edge crossing
+  REQUIRE(((xs[0] == 0.5 && ys[0] == 0 && xs[1] == 1 && ys[1] == 0.5) ||
+           (xs[1] == 0.5 && ys[1] == 0 && xs[0] == 1 && ys[0] == 0.5)));
+
+  INFO("a level outside the values gives no lines")
+  xs.clear(); ys.clear(); starts.clear();
+  march_squares({0, 1, 0, 1}, 2, 2, 2, xs, ys, starts);
+  REQUIRE(starts.empty());
+}
+
+TEST_CASE( "Test PlotData polyline", "[plot]" ) {
+
+  auto data = std::make_shared<PlotData>();
+  data->add_polyline({9, 0, 1, 2}, {9, 0, 1, 0}, 1, 3, 0);
+  data->add_image(0, 1, 1, 1, 1, 1, {5}, PlotData::LINEAR);
+
+  REQUIRE(data->polylines.size() == 1);
+  REQUIRE(data->polylines[0].count == 3);
+
+  PlotSequence plot(data);
+  Expression line = plot.at(0);
+  REQUIRE(line.get_property(Atom("\"object-name\"")) == Expression(Atom("\"polyline\"")));
+  REQUIRE(line.get_property(Atom("\"thickness\"")) == Expression(0.));
+  REQUIRE(line.tailSize() == 3);
+  REQUIRE(line.tailAt(2).tailAt(0) == Expression(2.));
+
+  REQUIRE(plot.at(1).get_property(Atom("\"shading\"")) == Expression(Atom("\"linear\"")));
+}
+
+// collects the chunks published by a PlotStream
+class CollectSink: public PlotSink {
+public:
+
+  void receive(std::size_t stream, std::shared_ptr<const PlotData> chunk, bool last){
+    streams.push_back(stream);
+    chunks.push_back(chunk);
+    lasts.push_back(last);
+  }
+
+  std::vector<std::size_t> streams;
+  std::vector<std::shared_ptr<const PlotData>> chunks;
+  std::vector<bool> lasts;
+};
+
+TEST_CASE( "Test PlotData extract", "[plot]" ) {
+
+  PlotData data;
+  data.view = {2, -2, 0, 0, 2, -2};
+  data.add_line(0, 0, 1, 1, 0);
+  data.begin_series();
+  data.add_point(1, 1, 0.5);
+  data.end_series();
+  data.begin_series();
+  data.add_point(2, 2, 0.5);
+  data.add_point(3, 3, 0.5);
+  data.end_series();
+  data.add_text("\"t\"", 0, 0, 0.5, 1, 1.5);
+
+  auto chunk = data.extract(3, 5);
+  REQUIRE(chunk->order.size() == 2);
+
+  INFO("series keep their index, those outside the run are empty")
+  REQUIRE(chunk->series.size() == 2);
+  REQUIRE(chunk->series[0].begin == chunk->series[0].end);
+  REQUIRE(chunk->series[1].begin == 0);
+  REQUIRE(chunk->series[1].end == 1);
+
+  INFO("the primitives read the same")
+  PlotSequence whole(std::make_shared<PlotData>(data));
+  PlotSequence part(chunk);
+  REQUIRE(part.at(0) == whole.at(3));
+  REQUIRE(part.at(1) == whole.at(4));
+  REQUIRE(part.at(1).get_property(Atom("\"text-rotation\"")) == Expression(1.5));
+}
+
+TEST_CASE( "Test PlotData groups and hash", "[plot]" ) {
+
+  // frame lines, a series, more frame lines, two labels and a second series
+  auto build = [](const std::string & title, double last){
+    PlotData data;
+    data.view = {2, -2, 0, 0, 2, -2};
+    data.add_line(0, 0, 1, 0, 0);
+    data.add_line(0, 0, 0, 1, 0);
+    data.begin_series();
+    data.add_point(1, 1, 0.5);
+    data.add_line(1, 1, 1, 0, 0);
+    data.end_series();
+    data.add_line(1, 0, 1, 1, 0);
+    data.add_text(title, 0, 2, 0.5, 1);
+    data.add_text("\"x\"", 0, -2, 0.5, 1);
+    data.begin_series();
+    data.add_point(2, last, 0.5);
+    data.end_series();
+    return data;
+  };
+  PlotData data = build("\"title\"", 2);
+
+  INFO("each series, each label and the runs between them are groups")
+  std::vector<std::size_t> bounds = data.groups(0, data.order.size());
+  REQUIRE(bounds == std::vector<std::size_t>({0, 2, 4, 5, 6, 7, 8}));
+  REQUIRE(data.groups(3, 6) == std::vector<std::size_t>({3, 4, 5, 6}));
+
+  INFO("a changed title or series changes only its group's hash")
+  PlotData title = build("\"other\"", 2);
+  PlotData series = build("\"title\"", 3);
+  for(std::size_t g = 0; g + 1 < bounds.size(); ++g){
+    std::size_t begin = bounds[g], end = bounds[g + 1];
+    REQUIRE(data.hash(begin, end) == build("\"title\"", 2).hash(begin, end));
+    REQUIRE((data.hash(begin, end) == title.hash(begin, end)) == (begin != 5));
+    REQUIRE((data.hash(begin, end) == series.hash(begin, end)) == (begin != 7));
+  }
+
+  INFO("moving data by the view transform changes the hash of data groups only")
+  PlotData moved = build("\"title\"", 2);
+  moved.view.dx = 1;
+  REQUIRE(data.hash(0, 2) == moved.hash(0, 2));
+  REQUIRE(data.hash(2, 4) != moved.hash(2, 4));
+}
+
+TEST_CASE( "Test PlotStream chunks", "[plot]" ) {
+
+  CollectSink sink;
+  PlotData data;
+  PlotStream stream(&sink, data);
+
+  data.begin_series();
+  for(std::size_t i = 0; i < 2 * PLOT_STREAM_CHUNK + 10; ++i){
+    data.add_point(i, i, 0.5);
+    stream.flush();
+  }
+  data.end_series();
+  data.add_line(0, 0, 1, 1, 0);
+  stream.finish();
+
+  REQUIRE(sink.chunks.size() == 3);
+  REQUIRE(sink.chunks[0]->order.size() == PLOT_STREAM_CHUNK);
+  REQUIRE(sink.chunks[2]->order.size() == 11);
+  REQUIRE(!sink.lasts[1]);
+  REQUIRE(sink.lasts[2]);
+  REQUIRE(sink.streams[2] == data.stream);
+  REQUIRE(sink.streams[0] == data.stream);
+
+  INFO("each stream has its own serial, even for a plot at the same address")
+  std::size_t first = data.stream;
+  PlotStream again(&sink, data);
+  REQUIRE(data.stream != 0);
+  REQUIRE(data.stream != first);
+
+  INFO("an open series is cut at the end of the chunk")
+  REQUIRE(sink.chunks[1]->series[0].end == PLOT_STREAM_CHUNK);
+  REQUIRE(sink.chunks[2]->series[0].end == 10);
+
+  INFO("nothing is published without a sink")
+  PlotStream quiet(nullptr, data);
+  quiet.finish();
+}
@@ -1,3 +1,5 @@
+#include <atomic>
+#include <csignal>
 #include <string>
 #include <sstream>
 #include <iostream>
@@ -62,6 +64,18 @@ int eval_from_command(std::string argexp, Interpreter & interp){
   return eval_from_stream(expression, interp);
 }
 
+// the Interrupt of the running REPL kernel, for the SIGINT handler
+std::atomic<Interrupt *> kernel_interrupt(nullptr);
+
+// Control-C interrupts an evaluation in progress, at the prompt it exits as before
+void handle_sigint(int){
+  Interrupt * interrupt = kernel_interrupt;
+  if(interrupt && interrupt->request()) return;
+
+  std::signal(SIGINT, SIG_DFL);
+  std::raise(SIGINT);
+}
+
 // A REPL is a repeated read-eval-print loop
 void repl(){
   ThreadSafeQueue<std::string> program_queue;
@@ -69,6 +83,8 @@ void repl(){
   int running = 1;
 
   Interpreter interp(&program_queue, &expression_queue);
+  kernel_interrupt = interp.interrupt().get();
+  std::signal(SIGINT, handle_sigint);
 
   std::thread interp_th(interp);
 
@@ -89,7 +105,9 @@ void repl(){
         else if (line == "%reset") {
           program_queue.push("%stop");
           interp_th.join();
+          kernel_interrupt = nullptr;
           interp = Interpreter(&program_queue, &expression_queue);
+          kernel_interrupt = interp.interrupt().get();
           interp_th = std::thread(interp);
         }
         else if(line == "%exit") {
@@ -97,6 +115,11 @@ void repl(){
           interp_th.join();
           return;
         }
+        else if(line == "%interrupt") {
+          // evaluation is synchronous here, Control-C interrupts it while it runs
+          interp.interrupt()->request();
+        }
+        else if(set_budget(*interp.interrupt(), line)) {}
         else error("invalid kernel directive");
       }
       else {
@@ -118,13 +141,17 @@ void repl(){
         else if (line == "%reset") {
           running = 1;
           interp_th.join();
+          kernel_interrupt = nullptr;
           interp = Interpreter(&program_queue, &expression_queue);
+          kernel_interrupt = interp.interrupt().get();
           interp_th = std::thread(interp);
         }
         else if(line == "%exit") {
           interp_th.join();
           return;
         }
+        else if(line == "%interrupt") {}
+        else if(set_budget(*interp.interrupt(), line)) {}
         else error("invalid kernel directive");
       }
       else error("interpreter kernel not running");
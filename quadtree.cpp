@@ -0,0 +1,159 @@
+#include "quadtree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+const std::size_t QuadTree::NONE;
+
+// nodes with at most this many points are not split
+const std::size_t QUADTREE_LEAF_SIZE = 16;
+
+// depth limit, reached only by many points at nearly the same position
+const int QUADTREE_MAX_DEPTH = 24;
+
+QuadTree::QuadTree(){}
+
+QuadTree::QuadTree(std::vector<double> xs, std::vector<double> ys):
+  m_x(std::move(xs)), m_y(std::move(ys)){
+
+  for(std::size_t i = 0; i < m_x.size(); ++i){
+    if(!std::isnan(m_x[i]) && !std::isnan(m_y[i])) m_index.push_back(i);
+  }
+  if(m_index.empty()) return;
+
+  Node root = {0, 0, 0, 0, 0, m_index.size(), 0};
+  bound(root);
+  m_nodes.push_back(root);
+  build(0, 0);
+}
+
+std::size_t QuadTree::size() const noexcept{
+  return m_index.size();
+}
+
+// tight bounds of the points in the node's run
+void QuadTree::bound(Node & node) const{
+  if(node.begin == node.end) return;
+
+  node.left = node.right = m_x[m_index[node.begin]];
+  node.top = node.bottom = m_y[m_index[node.begin]];
+  for(std::size_t i = node.begin + 1; i < node.end; ++i){
+    node.left = std::min(node.left, m_x[m_index[i]]);
+    node.right = std::max(node.right, m_x[m_index[i]]);
+    node.top = std::min(node.top, m_y[m_index[i]]);
+    node.bottom = std::max(node.bottom, m_y[m_index[i]]);
+  }
+}
+
+void QuadTree::build(std::size_t node, int depth){
+  Node current = m_nodes[node];
+  if(current.end - current.begin <= QUADTREE_LEAF_SIZE || depth == QUADTREE_MAX_DEPTH) return;
+  if(current.left == current.right && current.top == current.bottom) return;
+
+  double mx = (current.left + current.right) / 2;
+  double my = (current.top + current.bottom) / 2;
+
+  // split the run into quadrants: top left, top right, bottom left, bottom right
+  auto first = m_index.begin() + current.begin;
+  auto last = m_index.begin() + current.end;
+  auto upper = [&](std::size_t i){ return m_y[i] < my; };
+  auto left = [&](std::size_t i){ return m_x[i] < mx; };
+
+  auto middle = std::partition(first, last, upper);
+  auto upper_split = std::partition(first, middle, left);
+  auto lower_split = std::partition(middle, last, left);
+
+  std::size_t bounds[5] = {current.begin,
+                           static_cast<std::size_t>(upper_split - m_index.begin()),
+                           static_cast<std::size_t>(middle - m_index.begin()),
+                           static_cast<std::size_t>(lower_split - m_index.begin()),
+                           current.end};
+
+  std::size_t child = m_nodes.size();
+  m_nodes[node].child = child;
+  for(int q = 0; q < 4; ++q){
+    Node quadrant = {0, 0, 0, 0, bounds[q], bounds[q + 1], 0};
+    bound(quadrant);
+    m_nodes.push_back(quadrant);
+  }
+  for(int q = 0; q < 4; ++q){
+    build(child + q, depth + 1);
+  }
+}
+
+std::size_t QuadTree::nearest(double px, double py, double max_distance) const{
+  std::size_t best = NONE;
+  double best_distance = max_distance * max_distance;
+  if(m_nodes.empty()) return best;
+
+  // squared distance from the position to a node's bounds
+  auto reach = [&](const Node & n){
+    double dx = std::max(std::max(n.left - px, px - n.right), 0.0);
+    double dy = std::max(std::max(n.top - py, py - n.bottom), 0.0);
+    return dx * dx + dy * dy;
+  };
+
+  // depth first, nearer children first, skipping nodes farther than the best so far
+  std::vector<std::size_t> stack(1, 0);
+  while(!stack.empty()){
+    const Node & n = m_nodes[stack.back()];
+    stack.pop_back();
+    if(n.begin == n.end || reach(n) > best_distance) continue;
+
+    if(n.child == 0){
+      for(std::size_t i = n.begin; i < n.end; ++i){
+        double dx = m_x[m_index[i]] - px;
+        double dy = m_y[m_index[i]] - py;
+        double distance = dx * dx + dy * dy;
+        if(distance <= best_distance){
+          best_distance = distance;
+          best = m_index[i];
+        }
+      }
+      continue;
+    }
+
+    std::pair<double, std::size_t> order[4];
+    for(std::size_t q = 0; q < 4; ++q){
+      order[q] = std::make_pair(reach(m_nodes[n.child + q]), n.child + q);
+    }
+    std::sort(order, order + 4);
+    for(int q = 3; q >= 0; --q){
+      stack.push_back(order[q].second);
+    }
+  }
+
+  return best;
+}
+
+std::vector<std::size_t> QuadTree::query(double left, double top, double right, double bottom) const{
+  std::vector<std::size_t> found;
+  if(m_nodes.empty()) return found;
+
+  std::vector<std::size_t> stack(1, 0);
+  while(!stack.empty()){
+    const Node & n = m_nodes[stack.back()];
+    stack.pop_back();
+    if(n.begin == n.end) continue;
+    if(n.right < left || n.left > right || n.bottom < top || n.top > bottom) continue;
+
+    // a node inside the rectangle contributes all its points unchecked
+    bool inside = n.left >= left && n.right <= right && n.top >= top && n.bottom <= bottom;
+    if(inside || n.child == 0){
+      for(std::size_t i = n.begin; i < n.end; ++i){
+        std::size_t p = m_index[i];
+        if(inside || (m_x[p] >= left && m_x[p] <= right && m_y[p] >= top && m_y[p] <= bottom)){
+          found.push_back(p);
+        }
+      }
+      continue;
+    }
+
+    for(std::size_t q = 0; q < 4; ++q){
+      stack.push_back(n.child + q);
+    }
+  }
+
+  return found;
+}
@@ -0,0 +1,73 @@
+/*! \file quadtree.hpp
+Defines a packed quadtree over point coordinates.
+
+The notebook indexes the points of each plot to find the point nearest the
+mouse and the points inside the visible region without visiting all of them.
+ */
+#ifndef QUADTREE_HPP
+#define QUADTREE_HPP
+
+#include <cstddef>
+#include <vector>
+
+/*! \class QuadTree
+\brief Spatial index of a fixed set of points, stored in flat arrays.
+
+Each node holds the tight bounds of its points and a run of the index array
+listing them. Inner nodes have four children, stored consecutively, splitting
+the node's points at the center of its bounds. Points with a NaN coordinate
+are not indexed.
+*/
+class QuadTree {
+public:
+
+  /// returned by nearest when no point is close enough
+  static const std::size_t NONE = static_cast<std::size_t>(-1);
+
+  /// construct an empty index
+  QuadTree();
+
+  /*! Construct the index of a set of points
+    \param xs the point x coordinates
+    \param ys the point y coordinates, the same length as xs
+  */
+  QuadTree(std::vector<double> xs, std::vector<double> ys);
+
+  /// the number of points indexed
+  std::size_t size() const noexcept;
+
+  /*! Find the point nearest a position
+    \param px the x coordinate of the position
+    \param py the y coordinate of the position
+    \param max_distance the largest distance to search
+    \return the index of the nearest point within max_distance, or NONE
+  */
+  std::size_t nearest(double px, double py, double max_distance) const;
+
+  /*! Find the points inside a rectangle, edges included
+    \return the indices of the points, in no particular order
+  */
+  std::vector<std::size_t> query(double left, double top, double right, double bottom) const;
+
+private:
+
+  struct Node {
+    double left;
+    double top;
+    double right;
+    double bottom;
+    std::size_t begin;
+    std::size_t end;
+    std::size_t child;
+  };
+
+  void build(std::size_t node, int depth);
+  void bound(Node & node) const;
+
+  std::vector<double> m_x;
+  std::vector<double> m_y;
+  std::vector<std::size_t> m_index;
+  std::vector<Node> m_nodes;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "quadtree.hpp"
+
+TEST_CASE( "Test QuadTree on an empty set", "[quadtree]" ) {
+
+  QuadTree empty;
+  REQUIRE(empty.size() == 0);
+  REQUIRE(empty.nearest(0, 0, 100) == QuadTree::NONE);
+  REQUIRE(empty.query(-1, -1, 1, 1).empty());
+
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  QuadTree skipped({nan, 1}, {0, nan});
+  REQUIRE(skipped.size() == 0);
+  REQUIRE(skipped.nearest(0, 0, 100) == QuadTree::NONE);
+}
+
+TEST_CASE( "Test QuadTree nearest and query", "[quadtree]" ) {
+
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> coordinate(-10, 10);
+
+  std::vector<double> xs, ys;
+  for(int i = 0; i < 5000; ++i){
+    xs.push_back(coordinate(generator));
+    ys.push_back(coordinate(generator));
+  }
+  // repeated points must not split forever
+  for(int i = 0; i < 100; ++i){
+    xs.push_back(1.5);
+    ys.push_back(-2.5);
+  }
+
+  QuadTree tree(xs, ys);
+  REQUIRE(tree.size() == xs.size());
+
+  INFO("nearest matches a linear search")
+  for(int trial = 0; trial < 200; ++trial){
+    double px = coordinate(generator);
+    double py = coordinate(generator);
+
+    double best = std::numeric_limits<double>::infinity();
+    for(std::size_t i = 0; i < xs.size(); ++i){
+      best = std::min(best, std::hypot(xs[i] - px, ys[i] - py));
+    }
+
+    std::size_t found = tree.nearest(px, py, 100);
+    REQUIRE(found != QuadTree::NONE);
+    REQUIRE(std::hypot(xs[found] - px, ys[found] - py) == Approx(best));
+
+    REQUIRE(tree.nearest(px, py, best * 0.99) == QuadTree::NONE);
+  }
+
+  INFO("query matches a linear search")
+  for(int trial = 0; trial < 50; ++trial){
+    double left = coordinate(generator), right = coordinate(generator);
+    double top = coordinate(generator), bottom = coordinate(generator);
+    if(left > right) std::swap(left, right);
+    if(top > bottom) std::swap(top, bottom);
+
+    std::vector<std::size_t> expected;
+    for(std::size_t i = 0; i < xs.size(); ++i){
+      if(xs[i] >= left && xs[i] <= right && ys[i] >= top && ys[i] <= bottom) expected.push_back(i);
+    }
+
+    std::vector<std::size_t> found = tree.query(left, top, right, bottom);
+    std::sort(found.begin(), found.end());
+    REQUIRE(found == expected);
+  }
+
+  std::vector<std::size_t> repeated = tree.query(1.5, -2.5, 1.5, -2.5);
+  REQUIRE(repeated.size() >= 100);
+}
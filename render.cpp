@@ -0,0 +1,537 @@
+#include "render.hpp"
+
+#include <QGraphicsScene>
+#include <QGraphicsTextItem>
+#include <QGraphicsPixmapItem>
+#include <QGraphicsPathItem>
+#include <QPixmap>
+#include <QTransform>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "plot.hpp"
+#include "plot_item.hpp"
+
+// property names, built once so decoding a primitive looks them up without allocating
+static const std::string SIZE_KEY("\"size\"");
+static const std::string THICKNESS_KEY("\"thickness\"");
+static const std::string POSITION_KEY("\"position\"");
+static const std::string ROTATION_KEY("\"text-rotation\"");
+static const std::string SCALE_KEY("\"text-scale\"");
+static const std::string WIDTH_KEY("\"width\"");
+static const std::string HEIGHT_KEY("\"height\"");
+static const std::string SHADING_KEY("\"shading\"");
+
+Rendering::~Rendering() {
+  for (auto & object : m_objects) {
+    if (object.kind == PLOT) delete object.plot;
+  }
+}
+
+Rendering::Object & Rendering::add(Kind kind) {
+  Object object;
+  object.kind = kind;
+  object.x1 = object.y1 = object.x2 = object.y2 = 0;
+  object.width = 0;
+  object.scale = 1;
+  object.rotation = 0;
+  object.plot = nullptr;
+  m_objects.push_back(object);
+  return m_objects.back();
+}
+
+void Rendering::add_ellipse(const QRectF & rect, const QColor & color) {
+  Object & ellipse = add(ELLIPSE);
+  ellipse.rect = rect;
+  ellipse.color = color;
+}
+
+void Rendering::add_line(double x1, double y1, double x2, double y2, double width, const QColor & color) {
+  Object & line = add(LINE);
+  line.x1 = x1;
+  line.y1 = y1;
+  line.x2 = x2;
+  line.y2 = y2;
+  line.width = width;
+  line.color = color;
+}
+
+void Rendering::add_path(const QPainterPath & path, double width, const QColor & color) {
+  Object & object = add(PATH);
+  object.path = path;
+  object.width = width;
+  object.color = color;
+}
+
+void Rendering::add_text(const std::string & text, double x, double y, double scale, double rotation) {
+  Object & object = add(TEXT);
+  object.text = text;
+  object.x1 = x;
+  object.y1 = y;
+  object.scale = scale;
+  object.rotation = rotation;
+}
+
+void Rendering::add_message(const std::string & message) {
+  add(MESSAGE).text = message;
+}
+
+void Rendering::add_image(const QImage & image, const QRectF & rect) {
+  Object & object = add(IMAGE);
+  object.image = image;
+  object.rect = rect;
+}
+
+void Rendering::add_plot(PlotItem * item) {
+  add(PLOT).plot = item;
+}
+
+std::vector<QGraphicsItem *> Rendering::show(QGraphicsScene * scene) {
+  std::vector<QGraphicsItem *> items;
+  const double PI = std::atan2(0, -1);
+
+  // one font for all text shown
+  QFont font("Monospace");
+  font.setStyleHint(QFont::TypeWriter);
+  font.setPointSize(1);
+
+  for (auto & object : m_objects) {
+    if (object.kind == ELLIPSE) {
+      QGraphicsEllipseItem * point = scene->addEllipse(object.rect.left(), object.rect.top(),
+                                                       object.rect.width(), object.rect.height());
+      point->setBrush(object.color);
+      QPen pen;
+      pen.setWidth(0);
+      pen.setBrush(object.color);
+      point->setPen(pen);
+      items.push_back(point);
+    }
+    else if (object.kind == LINE) {
+      QGraphicsLineItem * line = scene->addLine(object.x1, object.y1, object.x2, object.y2);
+      QPen pen;
+      pen.setWidth(object.width);
+      pen.setColor(object.color);
+      line->setPen(pen);
+      items.push_back(line);
+    }
+    else if (object.kind == PATH) {
+      QGraphicsPathItem * line = scene->addPath(object.path);
+      QPen pen;
+      pen.setWidth(object.width);
+      pen.setColor(object.color);
+      line->setPen(pen);
+      items.push_back(line);
+    }
+    else if (object.kind == TEXT) {
+      QGraphicsTextItem * text = scene->addText(object.text.c_str());
+      text->setFont(font);
+      text->setScale(object.scale);
+      double height = text->boundingRect().height();
+      double width = text->boundingRect().width();
+      text->setTransformOriginPoint(QPointF(width/2, height/2));
+      text->setPos(object.x1 - (width/2), object.y1 - (height/2));
+      text->setRotation((180/PI) * object.rotation);
+      items.push_back(text);
+    }
+    else if (object.kind == MESSAGE) {
+      items.push_back(scene->addText(object.text.c_str()));
+    }
+    else if (object.kind == IMAGE) {
+      QGraphicsPixmapItem * item = scene->addPixmap(QPixmap::fromImage(object.image));
+      item->setTransform(QTransform::fromScale(object.rect.width() / object.image.width(),
+                                               object.rect.height() / object.image.height()));
+      item->setPos(object.rect.left(), object.rect.top());
+      items.push_back(item);
+    }
+    else if (object.plot) {
+      scene->addItem(object.plot);
+      items.push_back(object.plot);
+      object.plot = nullptr;
+    }
+  }
+
+  m_objects.clear();
+  return items;
+}
+
+// the tail element at index, copied into scratch only for a list backed by a sequence
+static const Expression & element(const Expression & exp, std::size_t index, Expression & scratch) {
+  if (!exp.isSequence()) return *(exp.tailConstBegin() + index);
+  scratch = exp.tailAt(index);
+  return scratch;
+}
+
+// the coordinates of a point, the first and last elements of its list
+static QPointF coordinates(const Expression & point) {
+  return QPointF(point.numberAt(0), point.numberAt(point.tailSize() - 1));
+}
+
+static void render_point(const Expression & exp, Rendering & out) {
+  QPointF center = coordinates(exp);
+  double diameter = exp.number_property(SIZE_KEY, 0);
+
+  if (!(diameter < 0.)) {
+    out.add_ellipse(QRectF(center.x() - diameter / 2, center.y() - diameter / 2, diameter, diameter), Qt::black);
+  }
+  else out.add_message("Error: Point size is not a positive number.");
+}
+
+static void render_line(const Expression & exp, Rendering & out) {
+  Expression scratch;
+  QPointF p1 = coordinates(element(exp, 0, scratch));
+  QPointF p2 = coordinates(element(exp, exp.tailSize() - 1, scratch));
+  double width = exp.number_property(THICKNESS_KEY, 0);
+
+  if (!(width < 0.)) out.add_line(p1.x(), p1.y(), p2.x(), p2.y(), width, Qt::black);
+  else out.add_message("Error: Line thickness is not a positive number.");
+}
+
+static void render_polyline(const Expression & exp, Rendering & out) {
+  if (exp.tailSize() == 0) return;
+
+  double width = exp.number_property(THICKNESS_KEY, 0);
+  if (width < 0.) {
+    out.add_message("Error: Line thickness is not a positive number.");
+    return;
+  }
+
+  Expression scratch;
+  QPainterPath path;
+  for (int i = 0; i < exp.tailSize(); ++i) {
+    QPointF point = coordinates(element(exp, i, scratch));
+    if (i == 0) path.moveTo(point);
+    else path.lineTo(point);
+  }
+  out.add_path(path, width, Qt::black);
+}
+
+// remove quotations at beginning and end
+static std::string unquote(std::string str) {
+  if (!str.empty() && str.front() == '"') {
+    str.replace(str.begin(), str.begin() + 1, "");
+    str.replace(str.end() - 1, str.end(), "");
+  }
+  return str;
+}
+
+static void render_text(const Expression & exp, Rendering & out) {
+  const Expression * position = exp.find_property(POSITION_KEY);
+
+  if (position && position->object_kind() == Expression::POINT) {
+    QPointF p = coordinates(*position);
+    double rotation = exp.number_property(ROTATION_KEY, 0);
+    double scale = exp.number_property(SCALE_KEY, 1);
+
+    out.add_text(unquote(exp.head().asSymbol()), p.x(), p.y(), scale, rotation);
+  }
+  else out.add_message("Error: Invalid position property");
+}
+
+// counts shade on a log scale from white (empty) to black (the densest
+// cell), linear values from white (smallest) to black (largest)
+static void render_image(double x, double y, double width, double height, std::size_t columns, std::size_t rows,
+                         const std::vector<double> & values, bool linear, Rendering & out) {
+  if (columns == 0 || rows == 0) return;
+
+  auto range = std::minmax_element(values.begin(), values.end());
+  double bottom = linear ? *range.first : 0;
+  double top = linear ? *range.second - bottom : std::log1p(*range.second);
+  QImage image(columns, rows, QImage::Format_RGB32);
+  for (std::size_t r = 0; r < rows; ++r) {
+    for (std::size_t c = 0; c < columns; ++c) {
+      double v = values[r * columns + c];
+      double level = linear ? v - bottom : std::log1p(v);
+      int shade = (top > 0) ? static_cast<int>(255 * (1 - level / top)) : 255;
+      image.setPixel(c, r, qRgb(shade, shade, shade));
+    }
+  }
+
+  out.add_image(image, QRectF(x, y, width, height));
+}
+
+static void render_image(const Expression & exp, Rendering & out) {
+  static const Expression LINEAR(Atom("\"linear\""));
+
+  const Expression * position = exp.find_property(POSITION_KEY);
+  QPointF p = position ? coordinates(*position) : QPointF(0, 0);
+  double width = exp.number_property(WIDTH_KEY, 0);
+  double height = exp.number_property(HEIGHT_KEY, 0);
+  const Expression * shading = exp.find_property(SHADING_KEY);
+  bool linear = shading && *shading == LINEAR;
+
+  Expression scratch;
+  std::size_t rows = exp.tailSize();
+  std::size_t columns = rows ? element(exp, 0, scratch).tailSize() : 0;
+  std::vector<double> values;
+  values.reserve(rows * columns);
+  for (std::size_t r = 0; r < rows; ++r) {
+    const Expression & row = element(exp, r, scratch);
+    for (std::size_t c = 0; c < columns; ++c) {
+      values.push_back(row.numberAt(c));
+    }
+  }
+
+  render_image(p.x(), p.y(), width, height, columns, rows, values, linear, out);
+}
+
+static void render_plot(const PlotSequence & plot, Rendering & out) {
+  const PlotData & data = plot.data();
+
+  // data primitives are placed in view here, the frame and labels already are
+  auto map = [&](double x, double y) { return QPointF(data.view.map_x(x), data.view.map_y(y)); };
+  auto vertex = [&](const PlotData::Item & item, std::size_t v) {
+    return item.data ? map(data.x[v], data.y[v]) : QPointF(data.x[v], data.y[v]);
+  };
+
+  // points and lines are collected into one item painting them in batches,
+  // with the data vertices and their values for reading under the mouse
+  auto batch = new PlotItem;
+  auto record = [&](PlotItem * target, const PlotData::Item & item, std::size_t v) {
+    if (item.data) target->add_value(map(data.x[v], data.y[v]), QPointF(data.x[v], data.y[v]));
+  };
+
+  // the curves of a continuous plot and the points of a decimated discrete plot
+  // get an item of their own, replaced when they are sampled again
+  auto curves = new PlotItem;
+  curves->set_sampler(data.sampler, data.view.sx, data.view.dx);
+
+  // each data series in its own color, the first in black
+  const QColor SERIES_COLORS[] = {Qt::black, Qt::blue, Qt::red, Qt::darkGreen,
+                                  Qt::magenta, Qt::darkCyan, Qt::darkYellow, Qt::gray};
+  const std::size_t NUM_COLORS = sizeof(SERIES_COLORS) / sizeof(SERIES_COLORS[0]);
+  std::size_t series = 0;
+
+  // draw straight from the plot arrays, in list order, the items are added once at the end
+  for (std::size_t i = plot.offset(); i < plot.offset() + plot.size(); ++i) {
+    const PlotData::Item & item = data.order[i];
+
+    while (series < data.series.size() && data.series[series].end <= i) ++series;
+    QColor color = Qt::black;
+    if (series < data.series.size() && data.series[series].begin <= i) {
+      color = SERIES_COLORS[series % NUM_COLORS];
+    }
+
+    if (item.kind == PlotData::POINT) {
+      const PlotData::Point & point = data.points[item.index];
+      double size = data.styles[point.style];
+      PlotItem * target = (data.sampler != 0 && item.data) ? curves : batch;
+      if (size < 0.) out.add_message("Error: Point size is not a positive number.");
+      else target->add_point(vertex(item, point.vertex), size, color);
+      record(target, item, point.vertex);
+    }
+    else if (item.kind == PlotData::LINE) {
+      const PlotData::Segment & segment = data.segments[item.index];
+      double width = data.styles[segment.style];
+      PlotItem * target = (data.sampler != 0 && item.data) ? curves : batch;
+      if (width < 0.) out.add_message("Error: Line thickness is not a positive number.");
+      else {
+        // the foot of a stem is in view already
+        QPointF from = vertex(item, segment.from);
+        if (segment.stem) from.setY(data.y[segment.from]);
+        target->add_line(from, vertex(item, segment.to), width, color);
+      }
+      // only the point a stem rises to is a data value
+      if (!segment.stem) {
+        record(target, item, segment.from);
+        record(target, item, segment.to);
+      }
+    }
+    else if (item.kind == PlotData::TEXT) {
+      const PlotData::Label & label = data.labels[item.index];
+      QPointF p = vertex(item, label.vertex);
+      out.add_text(unquote(label.text), p.x(), p.y(), label.scale, label.rotation);
+    }
+    else if (item.kind == PlotData::POLYLINE) {
+      const PlotData::Polyline & polyline = data.polylines[item.index];
+      std::vector<QPointF> points;
+      points.reserve(polyline.count);
+      for (std::size_t v = polyline.first; v < polyline.first + polyline.count; ++v) {
+        points.push_back(vertex(item, v));
+        record(batch, item, v);
+      }
+      double width = data.styles[polyline.style];
+      if (width < 0.) out.add_message("Error: Line thickness is not a positive number.");
+      else batch->add_polyline(points, width, color);
+    }
+    else {
+      const PlotData::Image & image = data.images[item.index];
+      double x = data.x[image.vertex];
+      double y = data.y[image.vertex];
+      QRectF rect(x, y, image.width, image.height);
+      if (item.data) {
+        rect = QRectF(map(x, y), map(x + image.width, y - image.height)).normalized();
+      }
+      render_image(rect.left(), rect.top(), rect.width(), rect.height(),
+                   image.columns, image.rows, image.values, image.shading == PlotData::LINEAR, out);
+    }
+  }
+
+  for (PlotItem * plot_item : {batch, curves}) {
+    if (plot_item->batches().empty()) {
+      delete plot_item;
+      continue;
+    }
+    plot_item->set_tiled(plot.size() >= PLOT_TILED_PRIMITIVES);
+    out.add_plot(plot_item);
+  }
+}
+
+// dispatch on the primitive tag cached by the expression, no property is looked up
+static void render_expression(const Expression & exp, Rendering & out) {
+  auto plot = std::dynamic_pointer_cast<const PlotSequence>(exp.sequence());
+  if (plot) {
+    render_plot(*plot, out);
+    return;
+  }
+
+  switch (exp.object_kind()) {
+  case Expression::POINT:
+    render_point(exp, out);
+    return;
+  case Expression::LINE:
+    render_line(exp, out);
+    return;
+  case Expression::TEXT:
+    render_text(exp, out);
+    return;
+  case Expression::IMAGE:
+    render_image(exp, out);
+    return;
+  case Expression::POLYLINE:
+    render_polyline(exp, out);
+    return;
+  default:
+    break;
+  }
+
+  if (exp.isList()) {
+    Expression scratch;
+    for(int i = 0; i < exp.tailSize(); ++i){
+       render_expression(element(exp, i, scratch), out);
+    }
+  }
+  else if (!exp.isLambda()) {
+    std::stringstream result;
+    result << exp;
+    out.add_message(result.str());
+  }
+}
+
+// a plot rendered as one group
+static RenderGroup render_group(std::size_t hash, const PlotSequence & plot) {
+  RenderGroup group = {hash, std::make_shared<Rendering>()};
+  render_plot(plot, *group.rendering);
+  return group;
+}
+
+static void render_plot_groups(std::shared_ptr<const PlotSequence> plot, std::vector<RenderGroup> & groups) {
+  const PlotData & data = plot->data();
+  std::vector<std::size_t> bounds = data.groups(plot->offset(), plot->offset() + plot->size());
+
+  for (std::size_t g = 0; g + 1 < bounds.size(); ++g) {
+    auto run = std::static_pointer_cast<const PlotSequence>(
+      plot->slice(bounds[g] - plot->offset(), bounds[g + 1] - plot->offset()));
+    groups.push_back(render_group(data.hash(bounds[g], bounds[g + 1]), *run));
+  }
+}
+
+// split a result into the groups retained between results: the runs of a
+// plot, and the elements of lists, rendered as the notebook draws them
+static void render_groups(const Expression & exp, std::vector<RenderGroup> & groups) {
+  auto plot = std::dynamic_pointer_cast<const PlotSequence>(exp.sequence());
+  bool object = exp.object_kind() != Expression::NONE;
+
+  if (plot) {
+    render_plot_groups(plot, groups);
+  }
+  else if (exp.isList() && !object) {
+    Expression scratch;
+    for (int i = 0; i < exp.tailSize(); ++i) {
+      render_groups(element(exp, i, scratch), groups);
+    }
+  }
+  else {
+    RenderGroup group = {exp.hash(), std::make_shared<Rendering>()};
+    render_expression(exp, *group.rendering);
+    groups.push_back(group);
+  }
+}
+
+Renderer::Renderer(ThreadSafeQueue<RenderJob> * jobs, ThreadSafeQueue<std::shared_ptr<Rendered>> * done,
+                   std::function<void()> notify):
+  jobs(jobs), done(done), notify(notify) {}
+
+std::shared_ptr<Rendered> Renderer::render(const RenderJob & job) {
+  auto out = std::make_shared<Rendered>();
+  out->kind = job.kind;
+  out->generation = job.generation;
+  out->message = out->streamed = out->whole = out->first = out->last = false;
+  out->sampler = 0;
+
+  // a plot streamed by a replaced kernel is never completed
+  if (job.generation != stream_generation) {
+    stream_serial = 0;
+    stream_complete = false;
+    stream_size = 0;
+    stream_generation = job.generation;
+  }
+
+  if (job.kind == RenderJob::RESULT) {
+    const Expression & exp = job.result;
+
+    // a plot result already shown whole from its chunks is not drawn again,
+    // unless it is large enough to be painted through tiles as one item, its
+    // chunks were not drawn past that size
+    auto plot = std::dynamic_pointer_cast<const PlotSequence>(exp.sequence());
+    out->streamed = plot && stream_complete && plot->data().stream == stream_serial &&
+                    plot->offset() == 0 && plot->size() == plot->data().order.size() &&
+                    plot->size() < PLOT_TILED_PRIMITIVES;
+    stream_serial = 0;
+    stream_complete = false;
+    stream_size = 0;
+
+    if (out->streamed) {}
+    else if (exp.head().asSymbol() == "Error") {
+      out->message = true;
+      out->text = exp.tailConstBegin()->head().asSymbol();
+    }
+    else render_groups(exp, out->groups);
+  }
+  else if (job.kind == RenderJob::CHUNK) {
+    const PlotChunk & chunk = job.chunk;
+
+    // a plot arriving whole is compared with what is shown, the first chunk
+    // of a larger plot replaces it
+    out->first = (chunk.stream != stream_serial);
+    out->whole = out->first && chunk.last;
+    out->last = chunk.last;
+    if (out->first) stream_size = 0;
+    stream_serial = chunk.stream;
+    stream_complete = chunk.last;
+    stream_size += chunk.data->order.size();
+
+    // a plot large enough to be painted through tiles is drawn once, from
+    // its result, the chunks past that size are not drawn
+    if (stream_size >= PLOT_TILED_PRIMITIVES) {}
+    else if (out->whole) render_plot_groups(std::make_shared<PlotSequence>(chunk.data), out->groups);
+    else out->groups.push_back(render_group(chunk.data->hash(0, chunk.data->order.size()), PlotSequence(chunk.data)));
+  }
+  else if (job.kind == RenderJob::CURVES) {
+    out->sampler = job.curves->sampler;
+    out->groups.push_back(render_group(0, PlotSequence(job.curves)));
+  }
+
+  return out;
+}
+
+void Renderer::operator()() {
+  while (1) {
+    RenderJob job;
+    jobs->wait_and_pop(job);
+    if (job.kind == RenderJob::STOP) return;
+
+    done->push(render(job));
+    if (notify) notify();
+  }
+}
@@ -0,0 +1,158 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <QColor>
+#include <QImage>
+#include <QPainterPath>
+#include <QRectF>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "expression.hpp"
+#include "threadsafequeue.hpp"
+
+class QGraphicsItem;
+class QGraphicsScene;
+class PlotData;
+class PlotItem;
+class PlotSequence;
+
+// plots with at least this many primitives are painted through cached raster tiles
+const std::size_t PLOT_TILED_PRIMITIVES = 100000;
+
+// a chunk of a plot published by the kernel while the plot is built
+struct PlotChunk {
+  std::size_t stream;
+  std::shared_ptr<const PlotData> data;
+  bool last;
+};
+
+// The scene items drawing a result, or one group of it, built on the render
+// thread: properties are decoded, geometry placed, paths built, images shaded
+// and plot primitives batched into finished PlotItems there. Only the light
+// items are created on the GUI thread, by show, which adds everything to the
+// scene in the order it was rendered.
+//
+// Text items are QObjects laid out by their document, so they are created by
+// show too, from the decoded string, position, scale and rotation.
+class Rendering {
+
+public:
+
+  Rendering() = default;
+
+  // deletes the plot items never shown
+  ~Rendering();
+
+  Rendering(const Rendering &) = delete;
+  Rendering & operator=(const Rendering &) = delete;
+
+  void add_ellipse(const QRectF & rect, const QColor & color);
+  void add_line(double x1, double y1, double x2, double y2, double width, const QColor & color);
+  void add_path(const QPainterPath & path, double width, const QColor & color);
+  void add_text(const std::string & text, double x, double y, double scale, double rotation);
+  void add_message(const std::string & message);
+  void add_image(const QImage & image, const QRectF & rect);
+
+  // takes ownership of item
+  void add_plot(PlotItem * item);
+
+  // add the items to scene, returning them, a rendering is shown at most once
+  std::vector<QGraphicsItem *> show(QGraphicsScene * scene);
+
+private:
+
+  enum Kind { ELLIPSE, LINE, PATH, TEXT, MESSAGE, IMAGE, PLOT };
+
+  struct Object {
+    Kind kind;
+    QRectF rect;
+    double x1, y1, x2, y2;
+    double width;
+    QColor color;
+    QPainterPath path;
+    std::string text;
+    double scale, rotation;
+    QImage image;
+    PlotItem * plot;
+  };
+
+  Object & add(Kind kind);
+
+  std::vector<Object> m_objects;
+};
+
+// a group of a result drawn and compared as one, by structural hash
+struct RenderGroup {
+  std::size_t hash;
+  std::shared_ptr<Rendering> rendering;
+};
+
+// work for the render thread, in the order the kernel sent it
+struct RenderJob {
+  enum Kind { RESULT, CHUNK, CURVES, STOP };
+
+  Kind kind;
+  // the kernel sending the job, results of replaced kernels are dropped
+  std::size_t generation;
+  Expression result;
+  PlotChunk chunk;
+  std::shared_ptr<const PlotData> curves;
+};
+
+// a job rendered for the GUI thread
+struct Rendered {
+  RenderJob::Kind kind;
+  std::size_t generation;
+
+  // a result to show as a message, an error, instead of groups
+  bool message;
+  std::string text;
+
+  // a plot result already shown whole from its chunks
+  bool streamed;
+
+  // a chunk holding a whole plot, shown by comparing its groups with those
+  // shown, otherwise whether it starts a plot and whether it ends it
+  bool whole;
+  bool first;
+  bool last;
+
+  // the SamplerRegistry id of re-sampled curves
+  std::size_t sampler;
+
+  std::vector<RenderGroup> groups;
+};
+
+// Renders the jobs queued by the kernel on a thread of its own, keeping
+// the GUI thread free for input while large results arrive. Run as a
+// functor, like the kernel, until a STOP job.
+class Renderer {
+
+public:
+
+  // notify is called on the render thread after each rendered job is pushed
+  Renderer(ThreadSafeQueue<RenderJob> * jobs, ThreadSafeQueue<std::shared_ptr<Rendered>> * done,
+           std::function<void()> notify);
+
+  std::shared_ptr<Rendered> render(const RenderJob & job);
+
+  void operator()();
+
+private:
+
+  ThreadSafeQueue<RenderJob> * jobs;
+  ThreadSafeQueue<std::shared_ptr<Rendered>> * done;
+  std::function<void()> notify;
+
+  // the stream serial of the plot being streamed in, whether its last chunk
+  // was rendered, the primitives received so far, and its kernel
+  std::size_t stream_serial = 0;
+  bool stream_complete = false;
+  std::size_t stream_size = 0;
+  std::size_t stream_generation = 0;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "sampler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <sstream>
+
+#include "environment.hpp"
+
+// ids are unique across registries, so a front end never mistakes the curves
+// of a reset kernel for those of the plot it is showing
+static std::atomic<std::size_t> next_sampler_id(1);
+
+SamplerRegistry::SamplerRegistry(std::size_t cache_size): m_cache_size(cache_size){}
+
+std::size_t SamplerRegistry::add(const std::vector<Expression> & lambdas, double x_min, double x_max,
+                                 const PlotData::ViewTransform & view){
+  Curves curves;
+  curves.lambdas = lambdas;
+  curves.x_min = x_min;
+  curves.x_max = x_max;
+  curves.view = view;
+  curves.cache.resize(lambdas.size());
+  return insert(std::move(curves));
+}
+
+std::size_t SamplerRegistry::add(std::shared_ptr<const PlotData> points, double x_min, double x_max,
+                                 double stem, double size){
+  Curves curves;
+  curves.x_min = x_min;
+  curves.x_max = x_max;
+  curves.view = points->view;
+  curves.points = std::move(points);
+  curves.stem = stem;
+  curves.size = size;
+  return insert(std::move(curves));
+}
+
+std::size_t SamplerRegistry::insert(Curves curves){
+  std::size_t id = next_sampler_id++;
+  m_curves.emplace(id, std::move(curves));
+
+  // ids grow, so the first entry is the oldest
+  if(m_curves.size() > SAMPLER_MAX_PLOTS){
+    m_curves.erase(m_curves.begin());
+  }
+
+  return id;
+}
+
+std::shared_ptr<PlotData> SamplerRegistry::resample(std::size_t id, double x0, double x1, double pixels,
+                                                    const Environment & env){
+  auto found = m_curves.find(id);
+  if(found == m_curves.end() || !(x0 < x1) || !(pixels >= 1)) return nullptr;
+  Curves & curves = found->second;
+
+  // the finest grid spacing needed for one sample per pixel of the requested range
+  double spacing = (x1 - x0) / pixels;
+  x0 = std::max(x0, curves.x_min);
+  x1 = std::min(x1, curves.x_max);
+  if(!(x0 < x1)) return nullptr;
+
+  if(curves.points){
+    auto plot = decimate(curves, x0, x1, (x1 - x0) / spacing);
+    plot->sampler = id;
+    return plot;
+  }
+
+  double span = curves.x_max - curves.x_min;
+  int level = 0;
+  while(level < SAMPLER_MAX_LEVEL && span / (SAMPLER_BASE_INTERVALS * std::pow(2., level)) > spacing){
+    ++level;
+  }
+
+  // the grid samples covering [x0, x1], coarser if there would be too many
+  long long intervals, k0, k1;
+  for(;; --level){
+    intervals = static_cast<long long>(SAMPLER_BASE_INTERVALS) << level;
+    k0 = std::max(0LL, static_cast<long long>(std::floor((x0 - curves.x_min) / span * intervals)));
+    k1 = std::min(intervals, static_cast<long long>(std::ceil((x1 - curves.x_min) / span * intervals)));
+    if(level == 0 || static_cast<std::size_t>(k1 - k0 + 1) <= SAMPLER_MAX_SAMPLES) break;
+  }
+
+  std::vector<double> xs;
+  std::vector<std::pair<int, long long>> keys;
+  for(long long k = k0; k <= k1; ++k){
+    xs.push_back((k == intervals) ? curves.x_max : curves.x_min + span * k / intervals);
+
+    // a sample shared with coarser grids is cached once, under the coarsest
+    int l = level;
+    long long key = k;
+    while(l > 0 && key % 2 == 0){
+      key /= 2;
+      --l;
+    }
+    keys.push_back(std::make_pair(l, key));
+  }
+
+  auto plot = std::make_shared<PlotData>();
+  plot->view = curves.view;
+  plot->sampler = id;
+
+  for(std::size_t s = 0; s < curves.lambdas.size(); ++s){
+    auto & cache = curves.cache[s];
+
+    // read the cached samples, and evaluate the others in one batch
+    std::vector<double> ys(xs.size());
+    std::vector<double> missing;
+    std::vector<std::size_t> where;
+    for(std::size_t i = 0; i < xs.size(); ++i){
+      auto hit = cache.find(keys[i]);
+      if(hit != cache.end()) ys[i] = hit->second;
+      else{
+        missing.push_back(xs[i]);
+        where.push_back(i);
+      }
+    }
+    std::vector<double> values = evaluate_lambda(curves.lambdas[s], missing, env);
+
+    // a full cache is dropped whole, the new samples are kept while they fit
+    if(cache.size() + where.size() > m_cache_size) cache.clear();
+    for(std::size_t i = 0; i < where.size(); ++i){
+      ys[where[i]] = values[i];
+      if(cache.size() < m_cache_size) cache.emplace(keys[where[i]], values[i]);
+    }
+
+    plot->begin_series();
+    for(std::size_t i = 1; i < xs.size(); ++i){
+      plot->add_line(xs[i - 1], ys[i - 1], xs[i], ys[i], PLOT_LINE_THICKNESS);
+    }
+    plot->end_series();
+  }
+
+  return plot;
+}
+
+std::shared_ptr<PlotData> SamplerRegistry::decimate(const Curves & curves, double x0, double x1,
+                                                    double pixels) const{
+  const PlotData & data = *curves.points;
+  std::size_t buckets = static_cast<std::size_t>(std::min(pixels, SAMPLER_MAX_SAMPLES / 2.));
+
+  auto plot = std::make_shared<PlotData>();
+  plot->view = curves.view;
+
+  for(std::size_t s = 0; s < data.raw_series.size(); ++s){
+    std::size_t end = (s + 1 < data.raw_series.size()) ? data.raw_series[s + 1] : data.raw_x.size();
+
+    // the points in view, all of them drawn when there are few
+    std::vector<double> sx, sy;
+    for(std::size_t i = data.raw_series[s]; i < end; ++i){
+      if(data.raw_x[i] >= x0 && data.raw_x[i] <= x1){
+        sx.push_back(data.raw_x[i]);
+        sy.push_back(data.raw_y[i]);
+      }
+    }
+
+    std::vector<std::size_t> drawn;
+    if(sx.size() > 2 * buckets){
+      drawn = decimate_min_max(sx, sy, x0, x1, buckets);
+    }
+    else{
+      for(std::size_t i = 0; i < sx.size(); ++i) drawn.push_back(i);
+    }
+
+    plot->begin_series();
+    for(auto i : drawn){
+      plot->add_point(sx[i], sy[i], curves.size);
+      plot->add_stem(sx[i], sy[i], curves.stem, PLOT_LINE_THICKNESS);
+    }
+    plot->end_series();
+  }
+
+  return plot;
+}
+
+bool resample(SamplerRegistry & registry, const std::string & directive, const Environment & env,
+              std::shared_ptr<PlotData> & curves){
+  std::istringstream iss(directive);
+  std::string name;
+  std::size_t id;
+  double x0, x1, pixels;
+
+  if(!(iss >> name >> id >> x0 >> x1 >> pixels) || name != "%resample" || !(iss >> std::ws).eof()) return false;
+
+  curves = registry.resample(id, x0, x1, pixels, env);
+  return true;
+}
@@ -0,0 +1,129 @@
+/*! \file sampler.hpp
+Defines the registry re-sampling the curves of continuous plots.
+
+continuous-plot draws its curves from a fixed number of samples. A front end
+that zooms into the plot asks the kernel to sample the visible range again at
+screen resolution, and draws the returned curves in place of the old ones.
+discrete-plot draws a decimated view of large data the same way, and the
+visible range is decimated again from the raw data.
+ */
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "expression.hpp"
+#include "plot.hpp"
+
+class Environment;
+
+/// number of uniform intervals continuous-plot samples its curves at
+const std::size_t SAMPLER_BASE_INTERVALS = 50;
+
+/// most halvings of the base interval a re-sample may use
+const int SAMPLER_MAX_LEVEL = 24;
+
+/// most samples of one curve in one re-sample
+const std::size_t SAMPLER_MAX_SAMPLES = 8192;
+
+/// number of plots whose curves or points are kept for re-sampling, the oldest are dropped
+const std::size_t SAMPLER_MAX_PLOTS = 16;
+
+/// number of samples cached per curve before its cache is emptied
+const std::size_t SAMPLER_CACHE_SIZE = 1 << 20;
+
+/*! \class SamplerRegistry
+\brief Keeps the lambdas of recent continuous plots to sample them again.
+
+Samples are taken on a grid of the plot's x range split into
+SAMPLER_BASE_INTERVALS intervals, halved as often as the requested
+resolution needs. Every grid sample is cached by its position, so zooming
+back out, panning, or zooming into a range sampled before only evaluates
+the lambdas where they were not sampled yet.
+*/
+class SamplerRegistry {
+public:
+
+  /*! Construct an empty registry
+    \param cache_size the most samples cached per lambda, the cache is dropped whole when full
+  */
+  explicit SamplerRegistry(std::size_t cache_size = SAMPLER_CACHE_SIZE);
+
+  /*! Register the curves of a continuous plot
+    \param lambdas the lambda of each series, in series order
+    \param x_min the start of the plotted range
+    \param x_max the end of the plotted range
+    \param view the plot's view transform
+    \return the id of the curves, unique in the process and never 0
+  */
+  std::size_t add(const std::vector<Expression> & lambdas, double x_min, double x_max,
+                  const PlotData::ViewTransform & view);
+
+  /*! Register the points of a decimated discrete plot
+    \param points the plot, its raw data read when it is re-sampled
+    \param x_min the smallest x of the data
+    \param x_max the largest x of the data
+    \param stem the view y coordinate the stems rise from
+    \param size the size of the points
+    \return the id of the points, unique in the process and never 0
+  */
+  std::size_t add(std::shared_ptr<const PlotData> points, double x_min, double x_max,
+                  double stem, double size);
+
+  /*! Sample registered curves over a range
+    \param id the id given by add
+    \param x0 the start of the range, clipped to the plotted range
+    \param x1 the end of the range, clipped to the plotted range
+    \param pixels the number of pixels across the range as shown
+    \param env the environment to evaluate the lambdas in
+    \return a plot with the plot's view transform and sampler id, holding one
+            series of lines per lambda, or one series of points and stems per
+            data series decimated to pixels columns, or nullptr for an unknown
+            id or empty range
+    \throws SemanticError when a lambda fails
+  */
+  std::shared_ptr<PlotData> resample(std::size_t id, double x0, double x1, double pixels,
+                                     const Environment & env);
+
+private:
+
+  struct Curves {
+    std::vector<Expression> lambdas;
+    double x_min;
+    double x_max;
+    PlotData::ViewTransform view;
+
+    // the discrete plot holding the raw data, nullptr for curves
+    std::shared_ptr<const PlotData> points;
+    double stem;
+    double size;
+
+    // per lambda, the sample at x_min + k (x_max - x_min) / (SAMPLER_BASE_INTERVALS 2^level)
+    // keyed by (level, k) with k odd or level 0
+    std::vector<std::map<std::pair<int, long long>, double>> cache;
+  };
+
+  std::size_t insert(Curves curves);
+  std::shared_ptr<PlotData> decimate(const Curves & curves, double x0, double x1, double pixels) const;
+
+  std::map<std::size_t, Curves> m_curves;
+  std::size_t m_cache_size;
+};
+
+/*! Apply a "%resample id x0 x1 pixels" kernel directive
+  \param registry the kernel's registry
+  \param directive the directive as sent by the front end
+  \param env the environment to evaluate the lambdas in
+  \param curves set to the re-sampled curves, nullptr when there are none
+  \return false if directive is not a valid resample directive
+  \throws SemanticError when a lambda fails
+*/
+bool resample(SamplerRegistry & registry, const std::string & directive, const Environment & env,
+              std::shared_ptr<PlotData> & curves);
+
+#endif
@@ -0,0 +1,120 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "plot.hpp"
+#include "sampler.hpp"
+
+// the lambda a program evaluates to
+static Expression make_lambda(const std::string & program){
+  Interpreter interp;
+  std::istringstream iss(program);
+  REQUIRE(interp.parseStream(iss));
+  return interp.evaluate();
+}
+
+TEST_CASE( "Test SamplerRegistry resample", "[sampler]" ) {
+
+  Environment env;
+  SamplerRegistry registry;
+  Expression square = make_lambda("(lambda (x) (* x x))");
+  Expression cube = make_lambda("(lambda (x) (* x x x))");
+  REQUIRE(square.isLambda());
+
+  PlotData::ViewTransform view = {5, -5, 0, 0, 5, -5};
+  std::size_t id = registry.add({square, cube}, -2, 2, view);
+  REQUIRE(id != 0);
+  REQUIRE(registry.add({square}, 0, 1, view) != id);
+
+  INFO("one series of lines per lambda over the clipped range, in the plot's view")
+  auto curves = registry.resample(id, -1, 5, 600, env);
+  REQUIRE(curves != nullptr);
+  REQUIRE(curves->sampler == id);
+  REQUIRE(curves->view.sx == 5);
+  REQUIRE(curves->series.size() == 2);
+
+  const PlotData::Series & first = curves->series[0];
+  REQUIRE(first.end - first.begin > 50);
+  REQUIRE(first.end - first.begin <= 600);
+  for(std::size_t i = first.begin; i < first.end; ++i){
+    const PlotData::Item & item = curves->order[i];
+    REQUIRE(item.kind == PlotData::LINE);
+    REQUIRE(item.data);
+
+    const PlotData::Segment & segment = curves->segments[item.index];
+    double x = curves->x[segment.to];
+    REQUIRE(x >= -1 - 1e-9);
+    REQUIRE(x <= 2 + 1e-9);
+    REQUIRE(curves->y[segment.to] == Approx(x * x));
+  }
+  const PlotData::Segment & last = curves->segments[curves->order[curves->series[1].end - 1].index];
+  REQUIRE(curves->x[last.to] == 2);
+  REQUIRE(curves->y[last.to] == Approx(8));
+
+  INFO("a finer re-sample keeps the coarser grid samples")
+  auto fine = registry.resample(id, -1, 0, 4000, env);
+  REQUIRE(fine != nullptr);
+  REQUIRE(fine->x[fine->segments[0].from] == Approx(-1));
+  REQUIRE(fine->y[fine->segments[0].from] == Approx(1));
+
+  INFO("unknown ids and ranges outside the plot give nothing")
+  REQUIRE(registry.resample(0, -1, 1, 100, env) == nullptr);
+  REQUIRE(registry.resample(id, 3, 4, 100, env) == nullptr);
+  REQUIRE(registry.resample(id, 1, -1, 100, env) == nullptr);
+}
+
+TEST_CASE( "Test SamplerRegistry keeps recent plots", "[sampler]" ) {
+
+  Environment env;
+  SamplerRegistry registry;
+  Expression square = make_lambda("(lambda (x) (* x x))");
+  PlotData::ViewTransform view = {1, -1, 0, 0, 1, -1};
+
+  std::size_t oldest = registry.add({square}, 0, 1, view);
+  std::size_t newest = oldest;
+  for(std::size_t i = 0; i < SAMPLER_MAX_PLOTS; ++i){
+    newest = registry.add({square}, 0, 1, view);
+  }
+
+  REQUIRE(registry.resample(oldest, 0, 1, 100, env) == nullptr);
+  REQUIRE(registry.resample(newest, 0, 1, 100, env) != nullptr);
+}
+
+TEST_CASE( "Test SamplerRegistry past a full cache", "[sampler]" ) {
+
+  Environment env;
+  SamplerRegistry registry(100);
+  Expression shifted = make_lambda("(lambda (x) (+ x 1))");
+  PlotData::ViewTransform view = {1, -1, 0, 0, 1, -1};
+  std::size_t id = registry.add({shifted}, 0, 1, view);
+
+  // narrow windows filling the cache many times over, some sampled again
+  for(std::size_t w = 0; w < 200; ++w){
+    double x0 = (w % 150) / 150.;
+    auto curves = registry.resample(id, x0, x0 + 0.01, 60, env);
+    REQUIRE(curves != nullptr);
+
+    for(auto & segment : curves->segments){
+      REQUIRE(curves->y[segment.from] == Approx(curves->x[segment.from] + 1));
+      REQUIRE(curves->y[segment.to] == Approx(curves->x[segment.to] + 1));
+    }
+  }
+}
+
+TEST_CASE( "Test resample directives", "[sampler]" ) {
+
+  Environment env;
+  SamplerRegistry registry;
+  std::shared_ptr<PlotData> curves;
+
+  REQUIRE(resample(registry, "%resample 7 0 1 100", env, curves));
+  REQUIRE(curves == nullptr);
+
+  REQUIRE(!resample(registry, "%resample", env, curves));
+  REQUIRE(!resample(registry, "%resample 7 0 1", env, curves));
+  REQUIRE(!resample(registry, "%resample 7 0 1 100 5", env, curves));
+  REQUIRE(!resample(registry, "%budget 7 0 1 100", env, curves));
+}
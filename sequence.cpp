@@ -0,0 +1,272 @@
+#include "sequence.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "semantic_error.hpp"
+
+RangeSequence::RangeSequence(double begin, double end, double increment):
+  m_begin(begin), m_increment(increment), m_offset(0), m_size(0){
+
+  // estimate the count, then correct for rounding at the upper limit
+  double span = std::floor((end - begin) / increment);
+  if(!std::isfinite(span) || span >= static_cast<double>(std::numeric_limits<std::size_t>::max())){
+    throw SemanticError("Error in call to range: too many elements");
+  }
+  if(span >= 0){
+    m_size = static_cast<std::size_t>(span) + 1;
+  }
+  while(begin + m_size * increment <= end){
+    ++m_size;
+  }
+  while(m_size > 0 && begin + (m_size - 1) * increment > end){
+    --m_size;
+  }
+}
+
+RangeSequence::RangeSequence(double begin, double increment, std::size_t offset, std::size_t size):
+  m_begin(begin), m_increment(increment), m_offset(offset), m_size(size){}
+
+std::size_t RangeSequence::size() const noexcept{
+  return m_size;
+}
+
+Expression RangeSequence::at(std::size_t index) const{
+  return Expression(m_begin + (m_offset + index) * m_increment);
+}
+
+std::shared_ptr<const Sequence> RangeSequence::slice(std::size_t begin, std::size_t end) const{
+  return std::shared_ptr<const Sequence>(new RangeSequence(m_begin, m_increment, m_offset + begin, end - begin));
+}
+
+VectorSequence::VectorSequence(std::vector<Expression> elements):
+  m_data(std::make_shared<const std::vector<Expression>>(std::move(elements))),
+  m_offset(0), m_size(m_data->size()){}
+
+VectorSequence::VectorSequence(std::shared_ptr<const std::vector<Expression>> data, std::size_t offset, std::size_t size):
+  m_data(data), m_offset(offset), m_size(size){}
+
+std::size_t VectorSequence::size() const noexcept{
+  return m_size;
+}
+
+Expression VectorSequence::at(std::size_t index) const{
+  return (*m_data)[m_offset + index];
+}
+
+std::shared_ptr<const Sequence> VectorSequence::slice(std::size_t begin, std::size_t end) const{
+  return std::shared_ptr<const Sequence>(new VectorSequence(m_data, m_offset + begin, end - begin));
+}
+
+// rope node, a leaf holds a sequence and an inner node two children
+struct PersistentSequence::Node {
+  std::shared_ptr<const Sequence> leaf;
+  std::shared_ptr<const Node> left;
+  std::shared_ptr<const Node> right;
+  std::size_t size;
+  int height;
+};
+
+// fixed capacity tail storage, slots below claimed are immutable
+struct PersistentSequence::Chunk {
+  Expression slots[CHUNK_SIZE];
+  std::atomic<std::size_t> claimed;
+
+  Chunk(): claimed(0){}
+};
+
+namespace {
+
+typedef PersistentSequence::Node Node;
+typedef std::shared_ptr<const Node> NodePtr;
+
+// view of the claimed slots of a tail chunk, used as a rope leaf
+class ChunkSequence: public Sequence {
+public:
+
+  ChunkSequence(std::shared_ptr<PersistentSequence::Chunk> chunk, std::size_t begin, std::size_t end):
+    m_chunk(chunk), m_begin(begin), m_end(end){}
+
+  std::size_t size() const noexcept{
+    return m_end - m_begin;
+  }
+
+  Expression at(std::size_t index) const{
+    return m_chunk->slots[m_begin + index];
+  }
+
+  std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const{
+    return std::make_shared<ChunkSequence>(m_chunk, m_begin + begin, m_begin + end);
+  }
+
+private:
+
+  std::shared_ptr<PersistentSequence::Chunk> m_chunk;
+  std::size_t m_begin;
+  std::size_t m_end;
+};
+
+int height(const NodePtr & node){
+  return node ? node->height : 0;
+}
+
+std::size_t size(const NodePtr & node){
+  return node ? node->size : 0;
+}
+
+NodePtr make_leaf(std::shared_ptr<const Sequence> seq){
+  if(seq->size() == 0) return nullptr;
+
+  auto node = std::make_shared<Node>();
+  node->leaf = seq;
+  node->size = seq->size();
+  node->height = 1;
+  return node;
+}
+
+NodePtr make_node(NodePtr left, NodePtr right){
+  auto node = std::make_shared<Node>();
+  node->left = left;
+  node->right = right;
+  node->size = left->size + right->size;
+  node->height = std::max(left->height, right->height) + 1;
+  return node;
+}
+
+// restore the AVL height invariant at node after one side grew by one level
+NodePtr rebalance(NodePtr left, NodePtr right){
+  if(height(left) > height(right) + 1){
+    if(height(left->left) >= height(left->right)){
+      return make_node(left->left, make_node(left->right, right));
+    }
+    return make_node(make_node(left->left, left->right->left),
+                     make_node(left->right->right, right));
+  }
+  if(height(right) > height(left) + 1){
+    if(height(right->right) >= height(right->left)){
+      return make_node(make_node(left, right->left), right->right);
+    }
+    return make_node(make_node(left, right->left->left),
+                     make_node(right->left->right, right->right));
+  }
+  return make_node(left, right);
+}
+
+// concatenate two ropes, O(|height(left) - height(right)|)
+NodePtr concat(NodePtr left, NodePtr right){
+  if(!left) return right;
+  if(!right) return left;
+
+  if(left->height > right->height + 1){
+    return rebalance(left->left, concat(left->right, right));
+  }
+  if(right->height > left->height + 1){
+    return rebalance(concat(left, right->left), right->right);
+  }
+  return make_node(left, right);
+}
+
+// the rope of elements [begin, end) of node
+NodePtr slice(const NodePtr & node, std::size_t begin, std::size_t end){
+  if(!node || begin >= end) return nullptr;
+  if(begin == 0 && end == node->size) return node;
+
+  if(node->leaf){
+    return make_leaf(node->leaf->slice(begin, end));
+  }
+
+  std::size_t split = node->left->size;
+  if(end <= split) return slice(node->left, begin, end);
+  if(begin >= split) return slice(node->right, begin - split, end - split);
+
+  return concat(slice(node->left, begin, split), slice(node->right, 0, end - split));
+}
+
+}
+
+PersistentSequence::PersistentSequence(std::shared_ptr<const Sequence> seq):
+  m_root(make_leaf(seq)), m_tail(nullptr), m_tailSize(0){}
+
+PersistentSequence::PersistentSequence(std::shared_ptr<const Node> root, std::shared_ptr<Chunk> tail, std::size_t tailSize):
+  m_root(root), m_tail(tail), m_tailSize(tailSize){}
+
+std::size_t PersistentSequence::size() const noexcept{
+  return ::size(m_root) + m_tailSize;
+}
+
+Expression PersistentSequence::at(std::size_t index) const{
+
+  if(index >= ::size(m_root)){
+    return m_tail->slots[index - ::size(m_root)];
+  }
+
+  const Node * node = m_root.get();
+  while(!node->leaf){
+    if(index < node->left->size){
+      node = node->left.get();
+    }
+    else{
+      index -= node->left->size;
+      node = node->right.get();
+    }
+  }
+
+  return node->leaf->at(index);
+}
+
+std::shared_ptr<const Node> PersistentSequence::flatten() const{
+  if(m_tailSize == 0) return m_root;
+
+  return concat(m_root, make_leaf(std::make_shared<ChunkSequence>(m_tail, 0, m_tailSize)));
+}
+
+std::shared_ptr<const Sequence> PersistentSequence::slice(std::size_t begin, std::size_t end) const{
+  return std::shared_ptr<const Sequence>(new PersistentSequence(::slice(flatten(), begin, end), nullptr, 0));
+}
+
+std::shared_ptr<const PersistentSequence> PersistentSequence::append(const Expression & exp) const{
+
+  // claim the next slot in place if this version owns the end of the chunk
+  std::size_t expected = m_tailSize;
+  if(m_tail && m_tailSize < CHUNK_SIZE && m_tail->claimed.compare_exchange_strong(expected, m_tailSize + 1)){
+    m_tail->slots[m_tailSize] = exp;
+    return std::shared_ptr<const PersistentSequence>(new PersistentSequence(m_root, m_tail, m_tailSize + 1));
+  }
+
+  // otherwise start a new chunk, moving a full tail into the rope
+  std::shared_ptr<const Node> root = m_root;
+  auto chunk = std::make_shared<Chunk>();
+  std::size_t count = 0;
+
+  if(m_tailSize == CHUNK_SIZE){
+    root = flatten();
+  }
+  else{
+    // another version owns the rest of the chunk, copy the shared slots
+    for(; count < m_tailSize; ++count){
+      chunk->slots[count] = m_tail->slots[count];
+    }
+  }
+
+  chunk->slots[count] = exp;
+  chunk->claimed = count + 1;
+
+  return std::shared_ptr<const PersistentSequence>(new PersistentSequence(root, chunk, count + 1));
+}
+
+std::shared_ptr<const PersistentSequence> PersistentSequence::join(std::shared_ptr<const Sequence> seq) const{
+
+  std::shared_ptr<const Node> right;
+
+  auto other = std::dynamic_pointer_cast<const PersistentSequence>(seq);
+  if(other){
+    right = other->flatten();
+  }
+  else{
+    right = make_leaf(seq);
+  }
+
+  return std::shared_ptr<const PersistentSequence>(new PersistentSequence(concat(flatten(), right), nullptr, 0));
+}
@@ -0,0 +1,166 @@
+/*! \file sequence.hpp
+Defines the Sequence interface and its implementations.
+
+A Sequence backs a list Expression whose elements are not stored directly in
+the Expression tail. Elements are produced on demand, so large lists can be
+passed around and consumed one element at a time.
+ */
+#ifndef SEQUENCE_HPP
+#define SEQUENCE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "expression.hpp"
+
+/*! \class Sequence
+\brief Abstract, immutable source of list elements.
+
+Sequences are shared between copies of an Expression, so implementations
+must not change after construction.
+*/
+class Sequence {
+public:
+
+  virtual ~Sequence(){}
+
+  /// number of elements in the sequence
+  virtual std::size_t size() const noexcept = 0;
+
+  /*! Produce the element at index
+    \param index the position of the element, must be less than size()
+    \return the element as an Expression
+  */
+  virtual Expression at(std::size_t index) const = 0;
+
+  /*! Produce a sequence of the elements in [begin, end)
+    \param begin the first index of the slice
+    \param end one past the last index of the slice
+    \return the new sequence
+  */
+  virtual std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const = 0;
+};
+
+/*! \class RangeSequence
+\brief Lazy arithmetic progression produced by the range procedure.
+
+Element i is computed as begin + i * increment, so only the three
+parameters are stored whatever the length of the range.
+*/
+class RangeSequence: public Sequence {
+public:
+
+  /*! Construct the range of numbers from begin to end (inclusive)
+    \param begin the first number in the range
+    \param end the upper limit of the range
+    \param increment the positive step between numbers
+    \throws SemanticError when the number of elements does not fit a size_t
+  */
+  RangeSequence(double begin, double end, double increment);
+
+  std::size_t size() const noexcept;
+
+  Expression at(std::size_t index) const;
+
+  std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const;
+
+private:
+
+  // construct a slice of an existing range
+  RangeSequence(double begin, double increment, std::size_t offset, std::size_t size);
+
+  double m_begin;
+  double m_increment;
+
+  // index of the first element relative to m_begin
+  std::size_t m_offset;
+  std::size_t m_size;
+};
+
+/*! \class VectorSequence
+\brief View of a contiguous run of elements in shared storage.
+
+Slicing a VectorSequence creates a new view of the same storage, so rest,
+slice, nth and last are O(1) and copying the list copies no elements.
+*/
+class VectorSequence: public Sequence {
+public:
+
+  /*! Construct a sequence owning the given elements
+    \param elements the list elements, moved into shared storage
+  */
+  VectorSequence(std::vector<Expression> elements);
+
+  std::size_t size() const noexcept;
+
+  Expression at(std::size_t index) const;
+
+  std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const;
+
+private:
+
+  // construct a view of existing storage
+  VectorSequence(std::shared_ptr<const std::vector<Expression>> data, std::size_t offset, std::size_t size);
+
+  std::shared_ptr<const std::vector<Expression>> m_data;
+  std::size_t m_offset;
+  std::size_t m_size;
+};
+
+/*! \class PersistentSequence
+\brief Persistent list built by append and join.
+
+The elements are held in a balanced rope whose leaves are other sequences,
+followed by a fixed capacity tail chunk. Appending claims the next free slot
+of the tail chunk in place when no other version has claimed it yet, so
+append is amortized O(1) and a full tail is moved into the rope in
+O(log n). Joining links the two ropes under a new node and rebalances in
+O(log n). Every earlier version stays valid, since a version only ever
+reads the slots it has claimed.
+*/
+class PersistentSequence: public Sequence {
+public:
+
+  /// number of elements held in the tail chunk before it moves into the rope
+  static const std::size_t CHUNK_SIZE = 32;
+
+  /*! Construct a persistent sequence holding the elements of another
+    \param seq the sequence to wrap, shared and not copied
+  */
+  PersistentSequence(std::shared_ptr<const Sequence> seq);
+
+  std::size_t size() const noexcept;
+
+  Expression at(std::size_t index) const;
+
+  std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const;
+
+  /*! Produce a new version with one element added at the end
+    \param exp the element to append
+    \return the new version, this version is unchanged
+  */
+  std::shared_ptr<const PersistentSequence> append(const Expression & exp) const;
+
+  /*! Produce a new version with the elements of another sequence added at the end
+    \param seq the sequence to join on, shared and not copied
+    \return the new version, this version is unchanged
+  */
+  std::shared_ptr<const PersistentSequence> join(std::shared_ptr<const Sequence> seq) const;
+
+  struct Node;
+  struct Chunk;
+
+private:
+
+  PersistentSequence(std::shared_ptr<const Node> root, std::shared_ptr<Chunk> tail, std::size_t tailSize);
+
+  // the rope followed by the tail as a single rope
+  std::shared_ptr<const Node> flatten() const;
+
+  std::shared_ptr<const Node> m_root;
+  std::shared_ptr<Chunk> m_tail;
+  std::size_t m_tailSize;
+};
+
+#endif
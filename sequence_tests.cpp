@@ -0,0 +1,146 @@
+#include "catch.hpp"
+
+#include "sequence.hpp"
+#include "semantic_error.hpp"
+
+TEST_CASE( "Test RangeSequence size and elements", "[sequence]" ) {
+
+  RangeSequence r(-2, 2, 0.5);
+
+  REQUIRE(r.size() == 9);
+  REQUIRE(r.at(0) == Expression(-2.));
+  REQUIRE(r.at(4) == Expression(0.));
+  REQUIRE(r.at(8) == Expression(2.));
+
+  INFO("upper limit not reached exactly")
+  RangeSequence s(0, 1, 0.3);
+  REQUIRE(s.size() == 4);
+
+  INFO("upper limit reached through rounding")
+  RangeSequence t(0, 1, 0.1);
+  REQUIRE(t.size() == 11);
+
+  INFO("more elements than a size_t counts")
+  REQUIRE_THROWS_AS(RangeSequence(0, 1e300, 1), SemanticError);
+  REQUIRE_THROWS_AS(RangeSequence(0, 1e300 * 1e300, 1), SemanticError);
+}
+
+TEST_CASE( "Test RangeSequence slice", "[sequence]" ) {
+
+  RangeSequence r(0, 10, 1);
+
+  auto s = r.slice(3, 6);
+  REQUIRE(s->size() == 3);
+  REQUIRE(s->at(0) == Expression(3.));
+  REQUIRE(s->at(2) == Expression(5.));
+
+  auto t = s->slice(1, 3);
+  REQUIRE(t->size() == 2);
+  REQUIRE(t->at(0) == Expression(4.));
+}
+
+TEST_CASE( "Test sequence-backed Expression", "[sequence]" ) {
+
+  Expression lazy(std::make_shared<RangeSequence>(1, 3, 1));
+
+  Expression list(Atom("list"));
+  list.append(Atom(1.));
+  list.append(Atom(2.));
+  list.append(Atom(3.));
+
+  REQUIRE(lazy.isList());
+  REQUIRE(lazy.isSequence());
+  REQUIRE(lazy.tailSize() == 3);
+  REQUIRE(lazy == list);
+  REQUIRE(list == lazy);
+
+  INFO("appending materializes the sequence")
+  lazy.append(Atom(4.));
+  REQUIRE(!lazy.isSequence());
+  REQUIRE(lazy.tailSize() == 4);
+  REQUIRE(lazy.tailAt(3) == Expression(4.));
+}
+
+TEST_CASE( "Test VectorSequence views", "[sequence]" ) {
+
+  std::vector<Expression> elements = {Expression(1.), Expression(2.), Expression(3.), Expression(4.)};
+  VectorSequence v(elements);
+
+  REQUIRE(v.size() == 4);
+  REQUIRE(v.at(3) == Expression(4.));
+
+  auto s = v.slice(1, 4);
+  REQUIRE(s->size() == 3);
+  REQUIRE(s->at(0) == Expression(2.));
+
+  auto t = s->slice(1, 2);
+  REQUIRE(t->size() == 1);
+  REQUIRE(t->at(0) == Expression(3.));
+
+  INFO("views keep the storage alive")
+  s = nullptr;
+  REQUIRE(t->at(0) == Expression(3.));
+}
+
+TEST_CASE( "Test PersistentSequence append keeps old versions", "[sequence]" ) {
+
+  std::vector<Expression> elements = {Expression(0.)};
+  auto base = std::make_shared<PersistentSequence>(std::make_shared<VectorSequence>(elements));
+
+  // grow well past several chunks, keeping every version
+  std::vector<std::shared_ptr<const PersistentSequence>> versions = {base};
+  for(int i = 1; i < 200; ++i){
+    versions.push_back(versions.back()->append(Expression(double(i))));
+  }
+
+  for(std::size_t v = 0; v < versions.size(); ++v){
+    REQUIRE(versions[v]->size() == v + 1);
+    REQUIRE(versions[v]->at(v) == Expression(double(v)));
+    REQUIRE(versions[v]->at(0) == Expression(0.));
+  }
+
+  INFO("branching from an old version does not disturb newer ones")
+  auto branch = versions[40]->append(Expression(-1.));
+  REQUIRE(branch->size() == 42);
+  REQUIRE(branch->at(41) == Expression(-1.));
+  REQUIRE(versions[41]->at(41) == Expression(41.));
+  REQUIRE(versions[199]->at(41) == Expression(41.));
+
+  auto twig = branch->append(Expression(-2.));
+  REQUIRE(twig->at(41) == Expression(-1.));
+  REQUIRE(twig->at(42) == Expression(-2.));
+}
+
+TEST_CASE( "Test PersistentSequence join and slice", "[sequence]" ) {
+
+  std::vector<Expression> model;
+  std::shared_ptr<const PersistentSequence> seq =
+    std::make_shared<PersistentSequence>(std::make_shared<VectorSequence>(std::vector<Expression>()));
+
+  // alternate appends and joins of ranges
+  for(int i = 0; i < 50; ++i){
+    seq = seq->append(Expression(double(-i)));
+    model.push_back(Expression(double(-i)));
+
+    auto range = std::make_shared<RangeSequence>(i, i + 3, 1);
+    seq = seq->join(range);
+    for(std::size_t j = 0; j < range->size(); ++j){
+      model.push_back(range->at(j));
+    }
+  }
+
+  REQUIRE(seq->size() == model.size());
+  for(std::size_t i = 0; i < model.size(); ++i){
+    REQUIRE(seq->at(i) == model[i]);
+  }
+
+  auto joined = seq->join(seq);
+  REQUIRE(joined->size() == 2 * model.size());
+  REQUIRE(joined->at(model.size() + 7) == model[7]);
+
+  auto part = seq->slice(13, 101);
+  REQUIRE(part->size() == 88);
+  for(std::size_t i = 0; i < part->size(); ++i){
+    REQUIRE(part->at(i) == model[13 + i]);
+  }
+}